@@ -0,0 +1,602 @@
+#include "../eval.h"
+#include "specific.h"
+
+typedef struct compiler
+{
+  nbuf code;
+  nbuf consts;
+  int depth;
+  int maxdepth;
+  bool failed;
+} compiler;
+
+// A value being evaluated. An owned one belongs to the evaluator, a
+// borrowed one is still part of variable 'var', reached from it by 'path',
+// or of a constant if 'var' is -1. Borrowed values are only copied when
+// they must outlive their source: stored in another variable or consed
+typedef struct value
+{
+  lisp *l;
+  bool owned;
+  int var;
+  lisp_path path;
+} value;
+
+int _form_op(const lisp *form);
+int _form_var(const lisp *v);
+void _emit(compiler *c, int v);
+void _patch(compiler *c, int at);
+void _stack(compiler *c, int delta);
+void _compile_expr(compiler *c, const lisp *e);
+void _compile_instr(compiler *c, const lisp *i);
+void _compile_block(compiler *c, const lisp *b);
+value _owned(lisp *l);
+value _borrowed(lisp *l, int var);
+lisp *_own(value v);
+void _drop(value v);
+void _store(lisp_env *env, int var, value v);
+value _apply1(int op, value x);
+value _apply2(int op, value x, value y);
+bool _equal(const lisp *x, const lisp *y);
+bool _truthy(value x);
+value _interp_expr(const lisp *e, lisp_env *env, bool *ok);
+void _interp_block(const lisp *b, lisp_env *env, bool *ok);
+
+void lisp_env_init(lisp_env *env)
+{
+  for (int i = 0; i < LISP_NVARS; i++)
+  {
+    env->vars[i] = NULL;
+  }
+}
+
+void lisp_env_free(lisp_env *env)
+{
+  for (int i = 0; i < LISP_NVARS; i++)
+  {
+    lisp_free(&env->vars[i]);
+  }
+}
+
+// Returns the operator of 'form' if it has the right number of operands
+int _form_op(const lisp *form)
+{
+  if (!form || lisp_isatomic(form) || !lisp_isatomic(lisp_car(form)))
+  {
+    return -1;
+  }
+  int op = lisp_getval(lisp_car(form));
+  int nargs;
+  switch (op)
+  {
+  case LISP_OP_NIL:
+    nargs = 0;
+    break;
+  case LISP_OP_QUOTE:
+  case LISP_OP_VAR:
+  case LISP_OP_CAR:
+  case LISP_OP_CDR:
+  case LISP_OP_LENGTH:
+    nargs = 1;
+    break;
+  case LISP_OP_CONS:
+  case LISP_OP_PLUS:
+  case LISP_OP_EQUAL:
+  case LISP_OP_LESS:
+  case LISP_OP_SET:
+  case LISP_OP_WHILE:
+    nargs = 2;
+    break;
+  case LISP_OP_IF:
+    nargs = 3;
+    break;
+  default:
+    return -1;
+  }
+  return lisp_length(form) == nargs + 1 ? op : -1;
+}
+
+int _form_var(const lisp *v)
+{
+  if (!lisp_isatomic(v) || lisp_getval(v) < 0 || lisp_getval(v) >= LISP_NVARS)
+  {
+    return -1;
+  }
+  return lisp_getval(v);
+}
+
+lisp_prog *lisp_compile(const lisp *program)
+{
+  compiler c = {{0}, {0}, 0, 0, false};
+  nbuf_init(&c.code, sizeof(int));
+  nbuf_init(&c.consts, sizeof(lisp *));
+  _compile_block(&c, program);
+  _emit(&c, BC_HALT);
+  lisp_prog *p = c.failed ? NULL : (lisp_prog *)ncalloc(1, sizeof(lisp_prog));
+  if (!p)
+  {
+    for (int i = 0; i < c.consts.n; i++)
+    {
+      lisp_free(&((lisp **)c.consts.data)[i]);
+    }
+    nbuf_free(&c.code);
+    nbuf_free(&c.consts);
+    return NULL;
+  }
+  p->code = (int *)c.code.data;
+  p->len = c.code.n;
+  p->consts = (lisp **)c.consts.data;
+  p->nconsts = c.consts.n;
+  p->depth = c.maxdepth;
+  return p;
+}
+
+void lisp_prog_free(lisp_prog **p)
+{
+  if (*p == NULL)
+  {
+    return;
+  }
+  for (int i = 0; i < (*p)->nconsts; i++)
+  {
+    lisp_free(&(*p)->consts[i]);
+  }
+  free((*p)->consts);
+  free((*p)->code);
+  free(*p);
+  *p = NULL;
+}
+
+void _emit(compiler *c, int v)
+{
+  int n = c->code.n;
+  int *code = (int *)nbuf_resize(&c->code, n + 1);
+  if (!code)
+  {
+    c->failed = true;
+    return;
+  }
+  code[n] = v;
+}
+
+// Points the jump operand at 'at' to the next instruction
+void _patch(compiler *c, int at)
+{
+  if (!c->failed)
+  {
+    ((int *)c->code.data)[at] = c->code.n;
+  }
+}
+
+void _stack(compiler *c, int delta)
+{
+  c->depth += delta;
+  if (c->depth > c->maxdepth)
+  {
+    c->maxdepth = c->depth;
+  }
+}
+
+void _compile_expr(compiler *c, const lisp *e)
+{
+  int op = _form_op(e);
+  switch (op)
+  {
+  case LISP_OP_QUOTE:
+  {
+    int n = c->consts.n;
+    lisp **consts = (lisp **)nbuf_resize(&c->consts, n + 1);
+    if (!consts)
+    {
+      c->failed = true;
+      return;
+    }
+    consts[n] = lisp_copy(lisp_cadr(e));
+    _emit(c, BC_CONST);
+    _emit(c, n);
+    _stack(c, 1);
+    return;
+  }
+  case LISP_OP_NIL:
+    _emit(c, BC_NIL);
+    _stack(c, 1);
+    return;
+  case LISP_OP_VAR:
+  {
+    int var = _form_var(lisp_cadr(e));
+    c->failed |= var < 0;
+    _emit(c, BC_LOAD);
+    _emit(c, var);
+    _stack(c, 1);
+    return;
+  }
+  case LISP_OP_CAR:
+  case LISP_OP_CDR:
+  case LISP_OP_LENGTH:
+    _compile_expr(c, lisp_cadr(e));
+    _emit(c, op == LISP_OP_CAR ? BC_CAR : (op == LISP_OP_CDR ? BC_CDR : BC_LENGTH));
+    return;
+  case LISP_OP_CONS:
+  case LISP_OP_PLUS:
+  case LISP_OP_EQUAL:
+  case LISP_OP_LESS:
+  {
+    _compile_expr(c, lisp_cadr(e));
+    _compile_expr(c, lisp_caddr(e));
+    bytecode bc[] = {BC_CONS, BC_PLUS, BC_EQUAL, BC_LESS};
+    int k = op == LISP_OP_CONS ? 0 : (op == LISP_OP_PLUS ? 1 : (op == LISP_OP_EQUAL ? 2 : 3));
+    _emit(c, bc[k]);
+    _stack(c, -1);
+    return;
+  }
+  default:
+    c->failed = true;
+  }
+}
+
+void _compile_instr(compiler *c, const lisp *i)
+{
+  int op = _form_op(i);
+  switch (op)
+  {
+  case LISP_OP_SET:
+  {
+    int var = _form_var(lisp_cadr(i));
+    c->failed |= var < 0;
+    _compile_expr(c, lisp_caddr(i));
+    _emit(c, BC_STORE);
+    _emit(c, var);
+    _stack(c, -1);
+    return;
+  }
+  case LISP_OP_IF:
+  {
+    _compile_expr(c, lisp_cadr(i));
+    _emit(c, BC_JMPF);
+    int to_else = c->code.n;
+    _emit(c, 0);
+    _stack(c, -1);
+    _compile_block(c, lisp_caddr(i));
+    _emit(c, BC_JMP);
+    int to_end = c->code.n;
+    _emit(c, 0);
+    _patch(c, to_else);
+    _compile_block(c, lisp_cadddr(i));
+    _patch(c, to_end);
+    return;
+  }
+  case LISP_OP_WHILE:
+  {
+    int top = c->code.n;
+    _compile_expr(c, lisp_cadr(i));
+    _emit(c, BC_JMPF);
+    int to_end = c->code.n;
+    _emit(c, 0);
+    _stack(c, -1);
+    _compile_block(c, lisp_caddr(i));
+    _emit(c, BC_JMP);
+    _emit(c, top);
+    _patch(c, to_end);
+    return;
+  }
+  default:
+    c->failed = true;
+  }
+}
+
+void _compile_block(compiler *c, const lisp *b)
+{
+  if (lisp_isatomic(b))
+  {
+    c->failed = true;
+    return;
+  }
+  for (const lisp *h = b; h && !c->failed; h = lisp_cdr(h))
+  {
+    _compile_instr(c, lisp_car(h));
+  }
+}
+
+value _owned(lisp *l)
+{
+  value v = {l, true, -1, {0, 0}};
+  return v;
+}
+
+value _borrowed(lisp *l, int var)
+{
+  value v = {l, false, var, {0, 0}};
+  return v;
+}
+
+// Takes 'v' over, copying it if borrowed
+lisp *_own(value v)
+{
+  return v.owned ? v.l : lisp_copy(v.l);
+}
+
+void _drop(value v)
+{
+  if (v.owned)
+  {
+    lisp_free(&v.l);
+  }
+}
+
+// A part of the variable itself is cut out of it, so
+// (SET 0 (CDR (VAR 0))) frees one cell instead of copying the rest
+void _store(lisp_env *env, int var, value v)
+{
+  if (!v.owned && v.var == var)
+  {
+    env->vars[var] = lisp_path_take(&env->vars[var], v.path);
+    return;
+  }
+  lisp *l = _own(v);
+  lisp_free(&env->vars[var]);
+  env->vars[var] = l;
+}
+
+// The operators on values, shared by the VM and the tree walker.
+// Operands are consumed, CAR and CDR of a borrowed value stay borrowed
+value _apply1(int op, value x)
+{
+  if (op == LISP_OP_LENGTH)
+  {
+    value r = _owned(lisp_atom(lisp_length(x.l)));
+    _drop(x);
+    return r;
+  }
+  bool is_car = op == LISP_OP_CAR;
+  lisp_path step = {is_car ? 1u : 0u, 1};
+  if (x.owned)
+  {
+    return _owned(lisp_path_take(&x.l, step));
+  }
+  lisp *r = is_car ? lisp_car(x.l) : lisp_cdr(x.l);
+  if (x.var < 0)
+  {
+    return _borrowed(r, -1);
+  }
+  // A path too long to record is copied out instead
+  if (x.path.len == LISP_PATHMAX)
+  {
+    return _owned(lisp_copy(r));
+  }
+  x.l = r;
+  x.path.ops |= step.ops << x.path.len;
+  x.path.len++;
+  return x;
+}
+
+value _apply2(int op, value x, value y)
+{
+  if (op == LISP_OP_CONS)
+  {
+    lisp *car = _own(x);
+    return _owned(lisp_cons(car, _own(y)));
+  }
+  lisp *r;
+  switch (op)
+  {
+  case LISP_OP_PLUS:
+    r = lisp_atom(lisp_getval(x.l) + lisp_getval(y.l));
+    break;
+  case LISP_OP_EQUAL:
+    r = lisp_atom(_equal(x.l, y.l));
+    break;
+  default:
+    r = lisp_atom(lisp_getval(x.l) < lisp_getval(y.l));
+  }
+  _drop(x);
+  _drop(y);
+  return _owned(r);
+}
+
+bool _equal(const lisp *x, const lisp *y)
+{
+  while (x && y)
+  {
+    if (lisp_isatomic(x) || lisp_isatomic(y))
+    {
+      return lisp_isatomic(x) && lisp_isatomic(y) && lisp_getval(x) == lisp_getval(y);
+    }
+    if (!_equal(lisp_car(x), lisp_car(y)))
+    {
+      return false;
+    }
+    x = lisp_cdr(x);
+    y = lisp_cdr(y);
+  }
+  return x == y;
+}
+
+// Consumes 'x'
+bool _truthy(value x)
+{
+  bool t = x.l && (!lisp_isatomic(x.l) || lisp_getval(x.l) != 0);
+  _drop(x);
+  return t;
+}
+
+// GCC and Clang dispatch through a table of label addresses
+// (computed goto), other compilers through the switch
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define DISPATCH() goto *labels[code[pc++]]
+#define TARGET(bc) \
+  case bc:         \
+  L_##bc:
+#else
+#define DISPATCH() continue
+#define TARGET(bc) case bc:
+#endif
+
+void lisp_run(const lisp_prog *p, lisp_env *env)
+{
+  if (!p || !env)
+  {
+    return;
+  }
+#if defined(__GNUC__)
+  static const void *labels[BC_COUNT] = {
+      [BC_HALT] = &&L_BC_HALT, [BC_CONST] = &&L_BC_CONST, [BC_NIL] = &&L_BC_NIL,
+      [BC_LOAD] = &&L_BC_LOAD, [BC_STORE] = &&L_BC_STORE, [BC_CAR] = &&L_BC_CAR,
+      [BC_CDR] = &&L_BC_CDR, [BC_CONS] = &&L_BC_CONS, [BC_PLUS] = &&L_BC_PLUS,
+      [BC_LENGTH] = &&L_BC_LENGTH, [BC_EQUAL] = &&L_BC_EQUAL, [BC_LESS] = &&L_BC_LESS,
+      [BC_JMP] = &&L_BC_JMP, [BC_JMPF] = &&L_BC_JMPF};
+#endif
+  value *stack = (value *)ncalloc(p->depth + 1, sizeof(value));
+  if (!stack)
+  {
+    return;
+  }
+  const int *code = p->code;
+  int pc = 0;
+  int sp = 0;
+  for (;;)
+  {
+    switch (code[pc++])
+    {
+      TARGET(BC_CONST)
+      stack[sp++] = _borrowed(p->consts[code[pc++]], -1);
+      DISPATCH();
+      TARGET(BC_NIL)
+      stack[sp++] = _owned(NULL);
+      DISPATCH();
+      TARGET(BC_LOAD)
+      stack[sp] = _borrowed(env->vars[code[pc]], code[pc]);
+      sp++;
+      pc++;
+      DISPATCH();
+      TARGET(BC_STORE)
+      _store(env, code[pc++], stack[--sp]);
+      DISPATCH();
+      TARGET(BC_CAR)
+      stack[sp - 1] = _apply1(LISP_OP_CAR, stack[sp - 1]);
+      DISPATCH();
+      TARGET(BC_CDR)
+      stack[sp - 1] = _apply1(LISP_OP_CDR, stack[sp - 1]);
+      DISPATCH();
+      TARGET(BC_LENGTH)
+      stack[sp - 1] = _apply1(LISP_OP_LENGTH, stack[sp - 1]);
+      DISPATCH();
+      TARGET(BC_CONS)
+      sp--;
+      stack[sp - 1] = _apply2(LISP_OP_CONS, stack[sp - 1], stack[sp]);
+      DISPATCH();
+      TARGET(BC_PLUS)
+      sp--;
+      stack[sp - 1] = _apply2(LISP_OP_PLUS, stack[sp - 1], stack[sp]);
+      DISPATCH();
+      TARGET(BC_EQUAL)
+      sp--;
+      stack[sp - 1] = _apply2(LISP_OP_EQUAL, stack[sp - 1], stack[sp]);
+      DISPATCH();
+      TARGET(BC_LESS)
+      sp--;
+      stack[sp - 1] = _apply2(LISP_OP_LESS, stack[sp - 1], stack[sp]);
+      DISPATCH();
+      TARGET(BC_JMP)
+      pc = code[pc];
+      DISPATCH();
+      TARGET(BC_JMPF)
+      pc = _truthy(stack[--sp]) ? pc + 1 : code[pc];
+      DISPATCH();
+      TARGET(BC_HALT)
+      free(stack);
+      return;
+    default:
+      on_error("Invalid bytecode");
+      free(stack);
+      return;
+    }
+  }
+}
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+value _interp_expr(const lisp *e, lisp_env *env, bool *ok)
+{
+  int op = _form_op(e);
+  switch (op)
+  {
+  case LISP_OP_QUOTE:
+    return _borrowed(lisp_cadr(e), -1);
+  case LISP_OP_NIL:
+    return _owned(NULL);
+  case LISP_OP_VAR:
+  {
+    int var = _form_var(lisp_cadr(e));
+    *ok &= var >= 0;
+    return var < 0 ? _owned(NULL) : _borrowed(env->vars[var], var);
+  }
+  case LISP_OP_CAR:
+  case LISP_OP_CDR:
+  case LISP_OP_LENGTH:
+    return _apply1(op, _interp_expr(lisp_cadr(e), env, ok));
+  case LISP_OP_CONS:
+  case LISP_OP_PLUS:
+  case LISP_OP_EQUAL:
+  case LISP_OP_LESS:
+  {
+    value x = _interp_expr(lisp_cadr(e), env, ok);
+    return _apply2(op, x, _interp_expr(lisp_caddr(e), env, ok));
+  }
+  default:
+    *ok = false;
+    return _owned(NULL);
+  }
+}
+
+void _interp_block(const lisp *b, lisp_env *env, bool *ok)
+{
+  *ok &= !lisp_isatomic(b);
+  for (const lisp *h = b; h && *ok; h = lisp_cdr(h))
+  {
+    const lisp *i = lisp_car(h);
+    int op = _form_op(i);
+    if (op == LISP_OP_SET)
+    {
+      int var = _form_var(lisp_cadr(i));
+      value v = _interp_expr(lisp_caddr(i), env, ok);
+      if (var < 0)
+      {
+        *ok = false;
+        _drop(v);
+        return;
+      }
+      _store(env, var, v);
+    }
+    else if (op == LISP_OP_IF)
+    {
+      bool t = _truthy(_interp_expr(lisp_cadr(i), env, ok));
+      _interp_block(t ? lisp_caddr(i) : lisp_cadddr(i), env, ok);
+    }
+    else if (op == LISP_OP_WHILE)
+    {
+      while (*ok && _truthy(_interp_expr(lisp_cadr(i), env, ok)))
+      {
+        _interp_block(lisp_caddr(i), env, ok);
+      }
+    }
+    else
+    {
+      *ok = false;
+    }
+  }
+}
+
+bool lisp_interp(const lisp *program, lisp_env *env)
+{
+  if (!env)
+  {
+    return false;
+  }
+  bool ok = true;
+  _interp_block(program, env, &ok);
+  return ok;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#define EVALIMPL "Bytecode"
+
+// VM instructions, operands follow inline in the code
+typedef enum bytecode
+{
+  BC_HALT,
+  // Push constant [n], borrowed
+  BC_CONST,
+  BC_NIL,
+  // Push variable [n], borrowed / pop into it
+  BC_LOAD,
+  BC_STORE,
+  BC_CAR,
+  BC_CDR,
+  BC_CONS,
+  BC_PLUS,
+  BC_LENGTH,
+  BC_EQUAL,
+  BC_LESS,
+  // Jump to [n] / jump to [n] if the popped value is false
+  BC_JMP,
+  BC_JMPF,
+  BC_COUNT
+} bytecode;
+
+struct lisp_prog
+{
+  int *code;
+  int len;
+  lisp **consts;
+  int nconsts;
+  // Deepest the value stack gets
+  int depth;
+};
@@ -1,14 +1,64 @@
 #include "general.h"
 
+#define NBUFINIT 16
+#define NBUFGROWTH 2
+
+static __thread errmode mode = ERR_EXIT;
+static __thread const char* lasterr = NULL;
+
+#ifdef NALLOC_FAULTS
+static __thread long allocbudget = -1;
+bool _alloc_allowed(void);
+#else
+#define _alloc_allowed() true
+#endif
+
+void set_errmode(errmode m)
+{
+   mode = m;
+}
+
+const char* last_error(void)
+{
+   return lasterr;
+}
+
+void clear_error(void)
+{
+   lasterr = NULL;
+}
+
 void on_error(const char* s)
 {
+   if(mode==ERR_RETURN){
+      lasterr = s;
+      return;
+   }
    fprintf(stderr, "%s\n", s);
    exit(EXIT_FAILURE);
 }
 
+#ifdef NALLOC_FAULTS
+void set_alloc_budget(long n)
+{
+   allocbudget = n;
+}
+
+bool _alloc_allowed(void)
+{
+   if(allocbudget==0){
+      return false;
+   }
+   if(allocbudget>0){
+      allocbudget--;
+   }
+   return true;
+}
+#endif
+
 void* ncalloc(int n, size_t size)
 {
-   void* v = calloc(n, size);
+   void* v = _alloc_allowed() ? calloc(n, size) : NULL;
    if(v==NULL){
       on_error("Cannot calloc() space");
    }
@@ -30,6 +80,9 @@ void** n2drecalloc(void** p, int oh, int nh, int ow, int nw, size_t szelem)
    void** n;
    int j;
    n = n2dcalloc(nh, nw, szelem);
+   if(n==NULL){
+      return NULL;
+   }
    for(j=0; j<oh; j++){
       memcpy(n[j], p[j], ow*szelem);
    }
@@ -43,14 +96,17 @@ void** n2dcalloc(int h, int w, size_t szelem)
 
    int i;
    void** p;
-   p = calloc(h, sizeof(void*));
+   p = _alloc_allowed() ? calloc(h, sizeof(void*)) : NULL;
    if(p==NULL){
       on_error("Cannot calloc() space");
+      return NULL;
    }
    for(i=0; i<h; i++){
-      p[i] = calloc(w, szelem);
+      p[i] = _alloc_allowed() ? calloc(w, szelem) : NULL;
       if(p[i]==NULL){
+         n2dfree(p, i);
          on_error("Cannot calloc() space");
+         return NULL;
       }
    }
    return p;
@@ -58,18 +114,140 @@ void** n2dcalloc(int h, int w, size_t szelem)
 
 void* nrecalloc(void* p, int oldbytes, int newbytes)
 {
-   void* n = calloc(newbytes, 1);
+   void* n = _alloc_allowed() ? realloc(p, newbytes) : NULL;
    if(n==NULL){
       on_error("Cannot calloc() space");
+      return NULL;
+   }
+   if(newbytes>oldbytes){
+      memset((char*)n+oldbytes, 0, newbytes-oldbytes);
+   }
+   return n;
+}
+
+void** n2dcalloc_contig(int h, int w, size_t szelem)
+{
+   int i;
+   void** p;
+   char* d;
+   p = _alloc_allowed() ? malloc(h*sizeof(void*)) : NULL;
+   d = _alloc_allowed() ? calloc((size_t)h*w, szelem) : NULL;
+   if(p==NULL || d==NULL){
+      free(p);
+      free(d);
+      on_error("Cannot calloc() space");
+      return NULL;
+   }
+   for(i=0; i<h; i++){
+      p[i] = d + (size_t)i*w*szelem;
+   }
+   return p;
+}
+
+void** n2drecalloc_contig(void** p, int oh, int nh, int ow, int nw, size_t szelem)
+{
+   int j;
+   int rows = oh<nh ? oh : nh;
+   size_t orow = (size_t)ow*szelem;
+   size_t nrow = (size_t)nw*szelem;
+   size_t osz = (size_t)oh*orow;
+   size_t nsz = (size_t)nh*nrow;
+   char* d = p[0];
+   char* t;
+   void** n;
+   /* Nothing in 'p' changes until both blocks are secured */
+   n = _alloc_allowed() ? malloc(nh*sizeof(void*)) : NULL;
+   if(n==NULL){
+      on_error("Cannot calloc() space");
+      return NULL;
+   }
+   if(nsz>osz){
+      t = _alloc_allowed() ? realloc(d, nsz) : NULL;
+      if(t==NULL){
+         free(n);
+         on_error("Cannot calloc() space");
+         return NULL;
+      }
+      d = t;
+   }
+   /* The slab now holds both layouts, narrower rows are packed
+      from the first one forwards, wider ones spread from the last */
+   if(nw<ow){
+      for(j=1; j<rows; j++){
+         memmove(d+j*nrow, d+j*orow, nrow);
+      }
+   }
+   if(nw>ow){
+      for(j=rows-1; j>=0; j--){
+         memmove(d+j*nrow, d+j*orow, orow);
+         memset(d+j*nrow+orow, 0, nrow-orow);
+      }
+   }
+   if(nh>oh){
+      memset(d+oh*nrow, 0, (nh-oh)*nrow);
+   }
+   /* Shrinking cannot lose any cell, so a failure keeps the larger slab */
+   if(nsz<osz){
+      t = realloc(d, nsz);
+      d = t ? t : d;
+   }
+   for(j=0; j<nh; j++){
+      n[j] = d+j*nrow;
    }
-   memcpy(n, p, oldbytes);
    free(p);
    return n;
 }
 
+void n2dfree_contig(void** p)
+{
+   if(p==NULL){
+      return;
+   }
+   free(p[0]);
+   free(p);
+}
+
+void nbuf_init(nbuf* b, size_t szelem)
+{
+   b->data = NULL;
+   b->n = 0;
+   b->cap = 0;
+   b->szelem = szelem;
+}
+
+void* nbuf_resize(nbuf* b, int n)
+{
+   int cap = b->cap;
+   void* d;
+   if(n>cap){
+      cap = cap ? cap : NBUFINIT;
+      while(cap<n){
+         cap = cap*NBUFGROWTH;
+      }
+      d = _alloc_allowed() ? realloc(b->data, (size_t)cap*b->szelem) : NULL;
+      if(d==NULL){
+         on_error("Cannot calloc() space");
+         return NULL;
+      }
+      b->data = d;
+      b->cap = cap;
+   }
+   if(n>b->n){
+      memset((char*)b->data+(size_t)b->n*b->szelem, 0, (size_t)(n-b->n)*b->szelem);
+   }
+   b->n = n;
+   return b->data;
+}
+
+void nbuf_free(nbuf* b)
+{
+   free(b->data);
+   nbuf_init(b, b->szelem);
+}
+
 void* nremalloc(void* p, int bytes)
 {
-   void* n = realloc(p, bytes);
+   void* n = _alloc_allowed() ? realloc(p, bytes) : NULL;
    if(n==NULL){
       on_error("Cannot malloc() space");
    }
@@ -3,11 +3,43 @@
 #include <string.h>
 #include <stdbool.h>
 
+/* How on_error() reacts, set per thread:
+   ERR_EXIT prints the message and exits (the default),
+   ERR_RETURN records it for last_error() and returns, so the
+   failing n*() helper returns NULL to its caller instead */
+typedef enum errmode {ERR_EXIT, ERR_RETURN} errmode;
+
+void set_errmode(errmode m);
+const char* last_error(void);
+void clear_error(void);
 void on_error(const char* s);
+#ifdef NALLOC_FAULTS
+/* Test builds only (-DNALLOC_FAULTS): makes the n*() helpers of this
+   thread fail as if out of memory once 'n' more allocations were made,
+   n<0 lifts it. Other builds allocate without checking any budget */
+void set_alloc_budget(long n);
+#endif
 void* ncalloc(int n, size_t size);
 void** n2dcalloc(int h, int w, size_t size);
 void** n2drecalloc(void** p, int oh, int nh, int ow, int nw, size_t szelem);
 void n2dfree(void**p, int h);
 void* nrecalloc(void* p, int oldsz, int newsz);
+/* Contiguous 2D arrays: one row-pointer block and one data slab,
+   h and w must be at least 1. Resizing grows the slab in place
+   where realloc() can and only zeroes the cells added.
+   If resizing fails (ERR_RETURN) NULL is returned and 'p' is unchanged */
+void** n2dcalloc_contig(int h, int w, size_t szelem);
+void** n2drecalloc_contig(void** p, int oh, int nh, int ow, int nw, size_t szelem);
+void n2dfree_contig(void** p);
+/* Growable buffer of n elements, capacity grows geometrically */
+typedef struct nbuf {
+   void* data;
+   int n;
+   int cap;
+   size_t szelem;
+} nbuf;
+void nbuf_init(nbuf* b, size_t szelem);
+void* nbuf_resize(nbuf* b, int n);
+void nbuf_free(nbuf* b);
 void* nremalloc(void* p, int bytes);
 void* nfopen(char* fname, char* mode);
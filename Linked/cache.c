@@ -0,0 +1,128 @@
+#include "../lisp.h"
+#include "specific.h"
+
+// Nodes moved between a thread and the depot at a time
+#define MAG_SIZE 64
+
+/* Each thread keeps freed nodes in its own magazine, so lisp_atom(),
+   lisp_cons() and lisp_free() need no locks whichever thread built the
+   list. A full magazine is pushed onto the shared depot as one batch:
+   nodes chained through their cdr, the first node's car linking the
+   next batch and its val holding the count. Batches are only pushed
+   singly with a CAS and taken all at once with an exchange, so the
+   depot is lock-free without suffering from ABA. */
+typedef struct cache
+{
+  // Loose nodes, chained through their cdr
+  lisp *loose;
+  int nloose;
+  // Whole batches taken from the depot, chained through their car
+  lisp *spare;
+} cache;
+
+static __thread cache local;
+static lisp *depot = NULL;
+
+void _depot_push(lisp *batch);
+lisp *_take_batch(lisp **from, int n);
+
+void _depot_push(lisp *batch)
+{
+  lisp *top = __atomic_load_n(&depot, __ATOMIC_RELAXED);
+  do
+  {
+    batch->car = top;
+  } while (!__atomic_compare_exchange_n(&depot, &top, batch, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Detaches the first 'n' nodes of the chain 'from' as a batch
+lisp *_take_batch(lisp **from, int n)
+{
+  lisp *batch = *from;
+  lisp *tail = batch;
+  for (int i = 1; i < n; i++)
+  {
+    tail = tail->cdr;
+  }
+  *from = tail->cdr;
+  tail->cdr = NULL;
+  batch->val = n;
+  return batch;
+}
+
+lisp *_cache_alloc(void)
+{
+  if (!local.loose)
+  {
+    if (!local.spare)
+    {
+      local.spare = __atomic_exchange_n(&depot, NULL, __ATOMIC_ACQUIRE);
+    }
+    if (local.spare)
+    {
+      lisp *batch = local.spare;
+      local.spare = batch->car;
+      local.loose = batch;
+      local.nloose = batch->val;
+    }
+  }
+  if (!local.loose)
+  {
+    PROF_COUNT(heap);
+    return (lisp *)ncalloc(1, sizeof(lisp));
+  }
+  lisp *l = local.loose;
+  local.loose = l->cdr;
+  local.nloose--;
+  memset(l, 0, sizeof(lisp));
+  return l;
+}
+
+void _cache_release(lisp *l)
+{
+  l->car = NULL;
+  l->cdr = local.loose;
+  local.loose = l;
+  local.nloose++;
+  // Keep one magazine at hand so alternating alloc/free never hits the depot
+  if (local.nloose == 2 * MAG_SIZE)
+  {
+    _depot_push(_take_batch(&local.loose, MAG_SIZE));
+    local.nloose -= MAG_SIZE;
+  }
+}
+
+void lisp_cache_flush(void)
+{
+  while (local.loose)
+  {
+    int n = local.nloose < MAG_SIZE ? local.nloose : MAG_SIZE;
+    _depot_push(_take_batch(&local.loose, n));
+    local.nloose -= n;
+  }
+  while (local.spare)
+  {
+    lisp *batch = local.spare;
+    local.spare = batch->car;
+    _depot_push(batch);
+  }
+}
+
+void lisp_cache_trim(void)
+{
+  lisp_cache_flush();
+  lisp *batch = __atomic_exchange_n(&depot, NULL, __ATOMIC_ACQUIRE);
+  while (batch)
+  {
+    lisp *next_batch = batch->car;
+    lisp *l = batch;
+    while (l)
+    {
+      lisp *next = l->cdr;
+      free(l);
+      l = next;
+    }
+    batch = next_batch;
+  }
+}
@@ -0,0 +1,312 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../lisp.h"
+#include "specific.h"
+#include <time.h>
+
+#define GC_SLAB_NODES 4096
+#define GC_THRESHOLD 65536
+#define GC_ROOTS_INIT 16
+#define GC_STACK_INIT 256
+
+typedef struct slab
+{
+  struct slab *next;
+  int size;
+  lisp nodes[];
+} slab;
+
+typedef struct gcheap
+{
+  bool active;
+  lisp_heapconf conf;
+  slab *slabs;
+  // Free nodes, chained through their cdr
+  lisp *free;
+  lisp ***roots;
+  int nroots;
+  int roots_cap;
+  lisp **stack;
+  int stack_cap;
+  // The mark stack could not grow, so this collection is abandoned
+  bool mark_failed;
+  long inuse;
+  long since_collect;
+  lisp_heapstats stats;
+} gcheap;
+
+// One collector per thread, so a thread entering collector mode
+// never changes how other threads allocate or free
+static __thread gcheap heap;
+
+void _gc_add_slab(void);
+void _gc_push(lisp *l, int *top);
+bool _gc_mark(void);
+void _gc_unmark(void);
+int _gc_sweep(void);
+double _gc_now_ms(void);
+
+bool _gc_active(void)
+{
+  return heap.active;
+}
+
+void lisp_heap_begin(const lisp_heapconf *conf)
+{
+  if (heap.active)
+  {
+    on_error("Collector already active");
+    return;
+  }
+  memset(&heap, 0, sizeof(gcheap));
+  heap.conf.slab_nodes = GC_SLAB_NODES;
+  heap.conf.threshold = GC_THRESHOLD;
+  if (conf && conf->slab_nodes > 0)
+  {
+    heap.conf.slab_nodes = conf->slab_nodes;
+  }
+  if (conf && conf->threshold > 0)
+  {
+    heap.conf.threshold = conf->threshold;
+  }
+  heap.active = true;
+}
+
+void lisp_heap_end(void)
+{
+  if (!heap.active)
+  {
+    return;
+  }
+  slab *s = heap.slabs;
+  while (s)
+  {
+    slab *next = s->next;
+    for (int i = 0; i < s->size; i++)
+    {
+      _lazy_drop(&s->nodes[i]);
+    }
+    free(s);
+    s = next;
+  }
+  free(heap.roots);
+  free(heap.stack);
+  memset(&heap, 0, sizeof(gcheap));
+}
+
+bool lisp_heap_addroot(lisp **root)
+{
+  if (!heap.active || !root)
+  {
+    return false;
+  }
+  if (heap.nroots == heap.roots_cap)
+  {
+    int cap = heap.roots_cap ? heap.roots_cap * 2 : GC_ROOTS_INIT;
+    lisp ***roots = nremalloc(heap.roots, cap * sizeof(lisp **));
+    if (!roots)
+    {
+      return false;
+    }
+    heap.roots = roots;
+    heap.roots_cap = cap;
+  }
+  heap.roots[heap.nroots++] = root;
+  return true;
+}
+
+void lisp_heap_removeroot(lisp **root)
+{
+  for (int i = 0; i < heap.nroots; i++)
+  {
+    if (heap.roots[i] == root)
+    {
+      heap.roots[i] = heap.roots[--heap.nroots];
+      return;
+    }
+  }
+}
+
+// lisp_free() in collector mode: the nodes are left for the next sweep
+void _gc_unroot(lisp **l)
+{
+  lisp_heap_removeroot(l);
+  *l = NULL;
+}
+
+lisp *_gc_alloc(void)
+{
+  if (!heap.free)
+  {
+    _gc_add_slab();
+  }
+  lisp *l = heap.free;
+  if (!l)
+  {
+    return NULL;
+  }
+  heap.free = l->cdr;
+  memset(l, 0, sizeof(lisp));
+  heap.inuse++;
+  heap.since_collect++;
+  return l;
+}
+
+void _gc_add_slab(void)
+{
+  int n = heap.conf.slab_nodes;
+  PROF_COUNT(heap);
+  slab *s = ncalloc(1, sizeof(slab) + n * sizeof(lisp));
+  if (!s)
+  {
+    return;
+  }
+  s->size = n;
+  s->next = heap.slabs;
+  heap.slabs = s;
+  for (int i = n - 1; i >= 0; i--)
+  {
+    s->nodes[i].cdr = heap.free;
+    heap.free = &s->nodes[i];
+  }
+  heap.stats.heap += n;
+}
+
+int lisp_heap_poll(void)
+{
+  if (!heap.active || heap.since_collect < heap.conf.threshold)
+  {
+    return 0;
+  }
+  return lisp_heap_collect();
+}
+
+int lisp_heap_collect(void)
+{
+  if (!heap.active)
+  {
+    return 0;
+  }
+  double bgn = _gc_now_ms();
+  if (!_gc_mark())
+  {
+    // Nothing may be freed without a full mark
+    _gc_unmark();
+    return 0;
+  }
+  int freed = _gc_sweep();
+  double pause = _gc_now_ms() - bgn;
+  heap.since_collect = 0;
+  heap.stats.collections++;
+  heap.stats.live = heap.inuse;
+  heap.stats.freed_total += freed;
+  heap.stats.last_pause_ms = pause;
+  heap.stats.total_pause_ms += pause;
+  if (pause > heap.stats.max_pause_ms)
+  {
+    heap.stats.max_pause_ms = pause;
+  }
+  return freed;
+}
+
+// Wall-clock time, unlike clock() which sums CPU time over all threads
+double _gc_now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000.0 * (double)ts.tv_sec + (double)ts.tv_nsec / 1e6;
+}
+
+void _gc_push(lisp *l, int *top)
+{
+  if (!l || (l->flags & LISP_MARK))
+  {
+    return;
+  }
+  if (*top == heap.stack_cap)
+  {
+    int cap = heap.stack_cap ? heap.stack_cap * 2 : GC_STACK_INIT;
+    lisp **stack = nremalloc(heap.stack, cap * sizeof(lisp *));
+    if (!stack)
+    {
+      heap.mark_failed = true;
+      return;
+    }
+    heap.stack = stack;
+    heap.stack_cap = cap;
+  }
+  l->flags |= LISP_MARK;
+  heap.stack[(*top)++] = l;
+}
+
+// Marks on push with an explicit stack, so deep or cyclic
+// structures neither recurse nor get visited twice.
+// Returns false if the stack ran out of memory
+bool _gc_mark(void)
+{
+  int top = 0;
+  heap.mark_failed = false;
+  for (int i = 0; i < heap.nroots && !heap.mark_failed; i++)
+  {
+    _gc_push(*heap.roots[i], &top);
+  }
+  while (top > 0 && !heap.mark_failed)
+  {
+    lisp *l = heap.stack[--top];
+    _gc_push(l->car, &top);
+    if (!(l->flags & LISP_LAZY))
+    {
+      _gc_push(l->cdr, &top);
+    }
+  }
+  return !heap.mark_failed;
+}
+
+void _gc_unmark(void)
+{
+  for (slab *s = heap.slabs; s; s = s->next)
+  {
+    for (int i = 0; i < s->size; i++)
+    {
+      s->nodes[i].flags &= ~LISP_MARK;
+    }
+  }
+}
+
+// Rebuilds the free list from every unmarked node and clears the marks
+int _gc_sweep(void)
+{
+  long marked = 0;
+  heap.free = NULL;
+  for (slab *s = heap.slabs; s; s = s->next)
+  {
+    for (int i = s->size - 1; i >= 0; i--)
+    {
+      lisp *l = &s->nodes[i];
+      if (l->flags & LISP_MARK)
+      {
+        l->flags &= ~LISP_MARK;
+        marked++;
+      }
+      else
+      {
+        _lazy_drop(l);
+        l->car = NULL;
+        l->cdr = heap.free;
+        heap.free = l;
+      }
+    }
+  }
+  int freed = (int)(heap.inuse - marked);
+  heap.inuse = marked;
+  return freed;
+}
+
+void lisp_heap_stats(lisp_heapstats *s)
+{
+  if (!s)
+  {
+    return;
+  }
+  *s = heap.stats;
+  s->live = heap.inuse;
+}
@@ -0,0 +1,152 @@
+#include "../lisp.h"
+#include "specific.h"
+
+// The cdr of a lazy cell. Only the last materialised cell of a lazy
+// list owns it, forcing that cell hands it on to the new last cell
+typedef struct thunk
+{
+  lisp_gen gen;
+  void *state;
+  // State of lisp_range(), 'state' then points back to the thunk
+  atomtype cur;
+  atomtype end;
+  atomtype step;
+  bool done;
+} thunk;
+
+lisp *_lazy_cell(thunk *t, bool *done);
+lisp *_lazy_first(thunk *t);
+bool _range_next(void *state, atomtype *val);
+
+lisp *lisp_lazy(lisp_gen generator, void *state)
+{
+  if (!generator)
+  {
+    return NULL;
+  }
+  PROF_COUNT(heap);
+  thunk *t = (thunk *)ncalloc(1, sizeof(thunk));
+  if (!t)
+  {
+    return NULL;
+  }
+  t->gen = generator;
+  t->state = state;
+  return _lazy_first(t);
+}
+
+lisp *lisp_range(atomtype a, atomtype b, atomtype step)
+{
+  bool is_empty = step > 0 ? a >= b : a <= b;
+  if (step == 0 || is_empty)
+  {
+    return NULL;
+  }
+  PROF_COUNT(heap);
+  thunk *t = (thunk *)ncalloc(1, sizeof(thunk));
+  if (!t)
+  {
+    return NULL;
+  }
+  t->gen = _range_next;
+  t->state = t;
+  t->cur = a;
+  t->end = b;
+  t->step = step;
+  return _lazy_first(t);
+}
+
+bool _range_next(void *state, atomtype *val)
+{
+  thunk *t = (thunk *)state;
+  if (t->done)
+  {
+    return false;
+  }
+  *val = t->cur;
+  // The distance left is taken in long long, so neither it nor the
+  // next 'cur' can overflow near either end of the atomtype range
+  long long left = (long long)t->end - t->cur;
+  bool is_last = t->step > 0 ? left <= t->step : left >= t->step;
+  if (is_last)
+  {
+    t->done = true;
+  }
+  else
+  {
+    t->cur += t->step;
+  }
+  return true;
+}
+
+// Pulls the next value into a new lazy cell that takes over 't'.
+// Returns NULL with '*done' set once the generator is exhausted, or
+// NULL without pulling anything if no cell could be allocated
+lisp *_lazy_cell(thunk *t, bool *done)
+{
+  *done = false;
+  // Allocate first, so running out of nodes never loses a value
+  lisp *a = lisp_atom(0);
+  lisp *l = a ? lisp_cons(a, NULL) : NULL;
+  if (!l)
+  {
+    lisp_free(&a);
+    return NULL;
+  }
+  atomtype val;
+  if (!t->gen(t->state, &val))
+  {
+    *done = true;
+    lisp_free(&l);
+    return NULL;
+  }
+  a->val = val;
+  l->cdr = (lisp *)t;
+  l->flags |= LISP_LAZY;
+  return l;
+}
+
+// The first cell of a new lazy list, releasing 't' if there is none
+lisp *_lazy_first(thunk *t)
+{
+  bool done;
+  lisp *l = _lazy_cell(t, &done);
+  if (!l)
+  {
+    free(t);
+  }
+  return l;
+}
+
+void _lazy_force(lisp *l)
+{
+  if (!(l->flags & LISP_LAZY))
+  {
+    return;
+  }
+  thunk *t = (thunk *)l->cdr;
+  bool done;
+  lisp *next = _lazy_cell(t, &done);
+  // Out of nodes: the cell stays lazy so a later visit retries
+  if (!next && !done)
+  {
+    return;
+  }
+  if (done)
+  {
+    free(t);
+  }
+  l->flags &= ~LISP_LAZY;
+  l->cdr = next;
+}
+
+void _lazy_drop(lisp *l)
+{
+  if (!(l->flags & LISP_LAZY))
+  {
+    return;
+  }
+  free(l->cdr);
+  l->cdr = NULL;
+  l->flags &= ~LISP_LAZY;
+}
@@ -6,20 +6,64 @@
 #define LIST_END ')'
 #define SEP ' '
 #define LISTSTRLEN 1000
+#define RECLAIM_BATCH 4096
 
 void _get_list_str(char *str, char *dest_str, int *end_idx);
+lisp *_fromstring(const char *str);
 lisp *_handle_num_bgn_str(const char *str);
 lisp *_handle_nonnum_bgn_str(char *str);
-void _close_string(char *str);
+bool _tostring(const lisp *l, char *str);
+bool _close_string(char *str);
 bool _format_string(char *str);
 bool _is_num_or_sign(const char c);
 bool _is_valid_char(const char c);
-void _hdl_snpf_rtn(int i);
+bool _hdl_snpf_rtn(int i);
 void test(void);
+lisp *_node_alloc(void);
+void _node_release(lisp *l);
+lisp *_cons_or_free(lisp *car, lisp *cdr);
+lisp *_copy(const lisp *l);
+
+// Detached trees awaiting reclamation by lisp_gc_step(), per thread
+static __thread lisp *reclaim_pending = NULL;
+
+// Set when building a list hit an error (ERR_RETURN), so
+// lisp_copy() and lisp_fromstring() drop the partial list
+static __thread bool build_failed = false;
+
+#ifdef LISP_PROFILE
+__thread lisp_allocstats _prof_allocs;
+
+lisp_allocstats lisp_prof_allocs(void)
+{
+  return _prof_allocs;
+}
+#endif
+
+lisp *_node_alloc(void)
+{
+  PROF_COUNT(nodes);
+  lisp *l = _gc_active() ? _gc_alloc() : _cache_alloc();
+  if (!l)
+  {
+    build_failed = true;
+  }
+  return l;
+}
+
+void _node_release(lisp *l)
+{
+  PROF_COUNT(releases);
+  _cache_release(l);
+}
 
 lisp *lisp_atom(const atomtype a)
 {
-  lisp *l = (lisp *)ncalloc(1, sizeof(lisp));
+  lisp *l = _node_alloc();
+  if (!l)
+  {
+    return NULL;
+  }
   l->car = NULL;
   l->cdr = NULL;
   l->val = a;
@@ -28,7 +72,11 @@ lisp *lisp_atom(const atomtype a)
 
 lisp *lisp_cons(const lisp *l1, const lisp *l2)
 {
-  lisp *l = (lisp *)ncalloc(1, sizeof(lisp));
+  lisp *l = _node_alloc();
+  if (!l)
+  {
+    return NULL;
+  }
   l->car = (lisp *)l1;
   l->cdr = (lisp *)l2;
   l->val = 0;
@@ -50,7 +98,9 @@ lisp *lisp_cdr(const lisp *l)
   {
     return NULL;
   }
-  return l->cdr;
+  _lazy_force((lisp *)l);
+  // Still lazy if no node was left to force it
+  return (l->flags & LISP_LAZY) ? NULL : l->cdr;
 }
 
 atomtype lisp_getval(const lisp *l)
@@ -63,6 +113,17 @@ atomtype lisp_getval(const lisp *l)
 }
 
 lisp *lisp_copy(const lisp *l)
+{
+  build_failed = false;
+  lisp *c = _copy(l);
+  if (build_failed)
+  {
+    lisp_free(&c);
+  }
+  return c;
+}
+
+lisp *_copy(const lisp *l)
 {
   if (!l)
   {
@@ -73,8 +134,20 @@ lisp *lisp_copy(const lisp *l)
   {
     return lisp_atom(lisp_getval(h));
   }
-  lisp *next_cdr = h->cdr ? lisp_copy(h->cdr) : NULL;
-  return lisp_cons(lisp_copy(h->car), next_cdr);
+  lisp *next_cdr = _copy(lisp_cdr(h));
+  return _cons_or_free(_copy(h->car), next_cdr);
+}
+
+// lisp_cons() that frees 'car' and 'cdr' instead if no node is left
+lisp *_cons_or_free(lisp *car, lisp *cdr)
+{
+  lisp *l = lisp_cons(car, cdr);
+  if (!l)
+  {
+    lisp_free(&car);
+    lisp_free(&cdr);
+  }
+  return l;
 }
 
 int lisp_length(const lisp *l)
@@ -88,7 +161,7 @@ int lisp_length(const lisp *l)
   while (h)
   {
     cnt++;
-    h = h->cdr;
+    h = lisp_cdr(h);
   }
   return cnt;
 }
@@ -99,15 +172,25 @@ void lisp_tostring(const lisp *l, char *str)
   {
     return;
   }
+  if (!_tostring(l, str))
+  {
+    str[0] = '\0';
+  }
+}
+
+bool _tostring(const lisp *l, char *str)
+{
   lisp *h = (lisp *)l;
   int r_v;
   if (lisp_isatomic(h))
   {
     r_v = snprintf(str, LISTSTRLEN, "%i", lisp_getval(h));
-    _hdl_snpf_rtn(r_v);
-    return;
+    return _hdl_snpf_rtn(r_v);
+  }
+  if (!_hdl_snpf_rtn(snprintf(str, LISTSTRLEN, "%c", LIST_BGN)))
+  {
+    return false;
   }
-  _hdl_snpf_rtn(snprintf(str, LISTSTRLEN, "%c", LIST_BGN));
   while (h)
   {
     char temp[LISTSTRLEN];
@@ -119,42 +202,55 @@ void lisp_tostring(const lisp *l, char *str)
     else
     {
       char car_str[LISTSTRLEN];
-      lisp_tostring(h->car, car_str);
+      if (!_tostring(h->car, car_str))
+      {
+        return false;
+      }
       r_v = snprintf(temp, LISTSTRLEN, "%s%s%c", str, car_str, SEP);
     }
-    _hdl_snpf_rtn(r_v);
+    if (!_hdl_snpf_rtn(r_v))
+    {
+      return false;
+    }
     strcpy(str, temp);
-    h = h->cdr;
+    h = lisp_cdr(h);
   }
-  _close_string(str);
+  return _close_string(str);
 }
 
-void _hdl_snpf_rtn(int i)
+bool _hdl_snpf_rtn(int i)
 {
   if (i <= 0)
   {
     on_error("Failed writing value");
+    return false;
   }
+  return true;
 }
 
 // Pads or replaces ending space with closing parenthesis
-void _close_string(char *str)
+bool _close_string(char *str)
 {
   if (!str)
   {
-    return;
+    return false;
   }
   int lng = strlen(str);
   char last_c = str[lng - 1];
   if (last_c != LIST_BGN && last_c != SEP)
   {
     on_error("Invalid string arg");
+    return false;
   }
   bool is_empty_list = last_c == LIST_BGN;
   char close_str[2];
-  _hdl_snpf_rtn(snprintf(close_str, 2, "%c", LIST_END));
+  if (!_hdl_snpf_rtn(snprintf(close_str, 2, "%c", LIST_END)))
+  {
+    return false;
+  }
   char *dest = is_empty_list ? str + lng : str + lng - 1;
   memcpy(dest, &close_str, 2);
+  return true;
 }
 
 bool lisp_isatomic(const lisp *l)
@@ -172,21 +268,107 @@ void lisp_free(lisp **l)
   {
     return;
   }
+  if (_gc_active())
+  {
+    _gc_unroot(l);
+    return;
+  }
   lisp *h = (lisp *)*l;
   if (lisp_isatomic(h))
   {
-    free(h);
+    _node_release(h);
   }
   else
   {
+    _lazy_drop(h);
     lisp_free(&(h->car));
     lisp_free(&(h->cdr));
-    free(h);
+    _node_release(h);
+  }
+  *l = NULL;
+}
+
+void lisp_free_async(lisp **l)
+{
+  if (*l == NULL)
+  {
+    return;
   }
+  if (_gc_active())
+  {
+    _gc_unroot(l);
+    return;
+  }
+  // Queue the root in O(1): the first tree becomes the queue itself,
+  // later ones hang off a new cons whose cdr is the existing queue
+  if (!reclaim_pending)
+  {
+    reclaim_pending = *l;
+    *l = NULL;
+    return;
+  }
+  lisp *q = lisp_cons(*l, reclaim_pending);
+  if (!q)
+  {
+    // Out of nodes (ERR_RETURN): keep the queue, free this tree now
+    lisp_free(l);
+    return;
+  }
+  reclaim_pending = q;
   *l = NULL;
 }
 
+// Each unit of work either frees the head node or rotates its car
+// onto the head, so the queue is consumed without recursion or extra memory
+int lisp_gc_step(int budget)
+{
+  int freed = 0;
+  while (reclaim_pending && budget > 0)
+  {
+    lisp *h = reclaim_pending;
+    // A pending thunk is released rather than materialised
+    _lazy_drop(h);
+    if (h->car)
+    {
+      lisp *c = h->car;
+      _lazy_drop(c);
+      h->car = c->cdr;
+      c->cdr = h;
+      reclaim_pending = c;
+    }
+    else
+    {
+      reclaim_pending = h->cdr;
+      _node_release(h);
+      freed++;
+    }
+    budget--;
+  }
+  return freed;
+}
+
+int lisp_gc_drain(void)
+{
+  int freed = 0;
+  while (reclaim_pending)
+  {
+    freed += lisp_gc_step(RECLAIM_BATCH);
+  }
+  return freed;
+}
+
 lisp *lisp_fromstring(const char *str)
+{
+  build_failed = false;
+  lisp *l = _fromstring(str);
+  if (build_failed)
+  {
+    lisp_free(&l);
+  }
+  return l;
+}
+
+lisp *_fromstring(const char *str)
 {
   if (!str)
   {
@@ -219,6 +401,10 @@ lisp *_handle_nonnum_bgn_str(char *str)
   char cur_c = str[0];
   char next_c = str[1];
   _get_list_str(str, list_str, &end_idx);
+  if (build_failed)
+  {
+    return NULL;
+  }
   bool is_sole_list = end_idx + 1 == str_lng;
   bool is_c_sep = cur_c == SEP;
   bool is_c_list_bgn = cur_c == LIST_BGN;
@@ -232,18 +418,18 @@ lisp *_handle_nonnum_bgn_str(char *str)
   }
   if (is_c_list_bgn && is_sole_list)
   {
-    return lisp_fromstring(list_str);
+    return _fromstring(list_str);
   }
   if (is_c_sep && !is_n_list_bgn)
   {
     char *next_num = str + 1;
-    return lisp_fromstring(next_num);
+    return _fromstring(next_num);
   }
   if (is_sub_list || has_next_list)
   {
     char *next_l = str + end_idx + 1;
-    lisp *cdr = is_sole_list ? NULL : lisp_fromstring(next_l);
-    return lisp_cons(lisp_fromstring(list_str), cdr);
+    lisp *cdr = is_sole_list ? NULL : _fromstring(next_l);
+    return _cons_or_free(_fromstring(list_str), cdr);
   }
   return NULL;
 }
@@ -261,10 +447,12 @@ lisp *_handle_num_bgn_str(const char *str)
   if (sscanf(str, "%d", &val) != 1)
   {
     on_error("Failed filling value");
+    build_failed = true;
+    return NULL;
   }
   char *rest_str = (char *)str + next_sep;
-  lisp *next = is_end ? NULL : lisp_fromstring(rest_str);
-  return lisp_cons(lisp_atom(val), next);
+  lisp *next = is_end ? NULL : _fromstring(rest_str);
+  return _cons_or_free(lisp_atom(val), next);
 }
 
 bool _is_num_or_sign(const char c)
@@ -325,9 +513,17 @@ void _get_list_str(char *str, char *dest_str, int *end_idx)
   if (!str || !dest_str || !end_idx)
   {
     on_error("Missing one or more input args");
+    build_failed = true;
+    return;
   }
   int ori_str_lng = strlen(str);
+  PROF_COUNT(heap);
   char *l_str = ncalloc(ori_str_lng + 1, sizeof(char));
+  if (!l_str)
+  {
+    build_failed = true;
+    return;
+  }
   int open_idx, left_paren_num = 0;
   for (int i = 0; i < ori_str_lng; i++)
   {
@@ -366,6 +562,17 @@ lisp *lisp_list(const int n, ...)
   {
     lisp *n = va_arg(valist, lisp *);
     lisp *l = lisp_cons(n, NULL);
+    if (!l)
+    {
+      // Free the new spine only, the lists passed in stay the caller's
+      for (lisp *h = head; h; h = h->cdr)
+      {
+        h->car = NULL;
+      }
+      lisp_free(&head);
+      va_end(valist);
+      return NULL;
+    }
     if (!head)
     {
       cur = head = l;
@@ -387,7 +594,7 @@ void lisp_reduce(void (*func)(lisp *l, atomtype *n), lisp *l, atomtype *acc)
     return;
   }
   lisp_reduce(func, l->car, acc);
-  lisp_reduce(func, l->cdr, acc);
+  lisp_reduce(func, lisp_cdr(l), acc);
   if (lisp_isatomic(l))
   {
     func(l, acc);
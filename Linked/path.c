@@ -0,0 +1,121 @@
+#include "../lisp.h"
+#include "specific.h"
+
+#define PATH_BGN 'c'
+#define PATH_END 'r'
+#define PATH_CAR 'a'
+#define PATH_CDR 'd'
+
+lisp *_path_step(const lisp *l, lisp_path p, int i);
+
+lisp_path lisp_path_compile(const char *spec)
+{
+  lisp_path p = {0, -1};
+  if (!spec)
+  {
+    return p;
+  }
+  int lng = strlen(spec);
+  int steps = lng - 2;
+  if (steps < 1 || steps > LISP_PATHMAX || spec[0] != PATH_BGN || spec[lng - 1] != PATH_END)
+  {
+    return p;
+  }
+  // The rightmost letter is applied first
+  for (int i = 0; i < steps; i++)
+  {
+    char c = spec[lng - 2 - i];
+    if (c == PATH_CAR)
+    {
+      p.ops |= 1u << i;
+    }
+    else if (c != PATH_CDR)
+    {
+      return p;
+    }
+  }
+  p.len = steps;
+  return p;
+}
+
+lisp *_path_step(const lisp *l, lisp_path p, int i)
+{
+  return (p.ops >> i) & 1u ? lisp_car(l) : lisp_cdr(l);
+}
+
+lisp *lisp_path_get(const lisp *l, lisp_path p)
+{
+  lisp *h = (lisp *)l;
+  for (int i = 0; i < p.len && h; i++)
+  {
+    h = _path_step(h, p, i);
+  }
+  return p.len < 0 ? NULL : h;
+}
+
+void lisp_extract(const lisp *l, const lisp_path *paths, int n, lisp **out)
+{
+  if (!paths || !out)
+  {
+    return;
+  }
+  // walked[i] is the node reached after i steps of the previous path
+  lisp *walked[LISP_PATHMAX + 1];
+  lisp_path prev = {0, 0};
+  walked[0] = (lisp *)l;
+  for (int k = 0; k < n; k++)
+  {
+    lisp_path p = paths[k];
+    if (p.len < 0)
+    {
+      out[k] = NULL;
+      continue;
+    }
+    int shared = 0;
+    unsigned int diff = p.ops ^ prev.ops;
+    while (shared < p.len && shared < prev.len && !((diff >> shared) & 1u))
+    {
+      shared++;
+    }
+    for (int i = shared; i < p.len; i++)
+    {
+      walked[i + 1] = walked[i] ? _path_step(walked[i], p, i) : NULL;
+    }
+    out[k] = walked[p.len];
+    prev = p;
+  }
+}
+
+lisp *lisp_path_take(lisp **l, lisp_path p)
+{
+  if (!l || p.len < 0)
+  {
+    return NULL;
+  }
+  // Collector lists may be shared, so no cell is cut
+  if (_gc_active())
+  {
+    lisp *part = lisp_path_get(*l, p);
+    lisp_free(l);
+    return part;
+  }
+  lisp *h = *l;
+  *l = NULL;
+  for (int i = 0; i < p.len && h; i++)
+  {
+    lisp *cell = h;
+    bool is_car = (p.ops >> i) & 1u;
+    h = _path_step(cell, p, i);
+    // Unlink the part kept, so freeing the cell leaves it alone
+    if (h && is_car)
+    {
+      cell->car = NULL;
+    }
+    else if (h)
+    {
+      cell->cdr = NULL;
+    }
+    lisp_free(&cell);
+  }
+  return h;
+}
@@ -7,4 +7,31 @@ struct lisp
   struct lisp *car;
   struct lisp *cdr;
   atomtype val;
+  unsigned char flags;
 };
+
+// Bits of lisp.flags
+#define LISP_MARK 0x1
+// The cdr is an unevaluated thunk, only lazy.c may look at it
+#define LISP_LAZY 0x2
+
+// Collector internals, see gc.c
+bool _gc_active(void);
+lisp *_gc_alloc(void);
+void _gc_unroot(lisp **l);
+
+// Per-thread node caches, see cache.c
+lisp *_cache_alloc(void);
+void _cache_release(lisp *l);
+
+// Allocation counters of -DLISP_PROFILE builds, see linked.c
+#ifdef LISP_PROFILE
+extern __thread lisp_allocstats _prof_allocs;
+#define PROF_COUNT(field) (_prof_allocs.field++)
+#else
+#define PROF_COUNT(field) ((void)0)
+#endif
+
+// Lazy cell internals, see lazy.c
+void _lazy_force(lisp *l);
+void _lazy_drop(lisp *l);
@@ -0,0 +1,195 @@
+#define _XOPEN_SOURCE 700
+#include "../lisp.h"
+#include "specific.h"
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define LIST_BGN '('
+#define LIST_END ')'
+#define SEP ' '
+#define NEWLINE '\n'
+#define WRITE_CHUNK 65536
+// Chunks handed to one writev() call, well below any IOV_MAX
+#define WRITE_BATCH 16
+// Room for the longest token: sign, digits and a separator
+#define TOKEN_MAX 32
+
+/* Lists are serialised straight into a per-thread pool of chunks and
+   each full pool goes out with a single writev(), so no intermediate
+   string is built per list. Tokens never straddle two chunks.
+   A chunk is only malloc()ed once output first reaches it and is kept
+   until lisp_write_release(). */
+typedef struct writer
+{
+  int fd;
+  struct iovec iov[WRITE_BATCH];
+  int cur;
+  char *pos;
+  char *end;
+  long written;
+  bool failed;
+} writer;
+
+static __thread char *pool[WRITE_BATCH];
+
+bool _write_begin(writer *w, int fd);
+void _write_flush(writer *w);
+void _write_reserve(writer *w);
+void _write_list(writer *w, const lisp *l);
+void _write_atom(writer *w, atomtype a);
+
+long lisp_write_fd(int fd, const lisp **ls, int n)
+{
+  writer w;
+  if (!ls || !_write_begin(&w, fd))
+  {
+    return -1;
+  }
+  for (int i = 0; i < n && !w.failed; i++)
+  {
+    _write_list(&w, ls[i]);
+    _write_reserve(&w);
+    *w.pos++ = NEWLINE;
+  }
+  _write_flush(&w);
+  return w.failed ? -1 : w.written;
+}
+
+long lisp_write_file(FILE *fp, const lisp **ls, int n)
+{
+  if (!fp || fflush(fp) != 0)
+  {
+    return -1;
+  }
+  return lisp_write_fd(fileno(fp), ls, n);
+}
+
+bool _write_begin(writer *w, int fd)
+{
+  if (!pool[0] && !(pool[0] = (char *)nremalloc(NULL, WRITE_CHUNK)))
+  {
+    return false;
+  }
+  w->fd = fd;
+  w->cur = 0;
+  w->pos = pool[0];
+  w->end = pool[0] + WRITE_CHUNK;
+  w->written = 0;
+  w->failed = false;
+  return true;
+}
+
+void lisp_write_release(void)
+{
+  for (int i = 0; i < WRITE_BATCH; i++)
+  {
+    free(pool[i]);
+    pool[i] = NULL;
+  }
+}
+
+// Writes out every filled chunk, retrying after partial writes
+void _write_flush(writer *w)
+{
+  int cnt = w->cur + 1;
+  w->iov[w->cur].iov_base = pool[w->cur];
+  w->iov[w->cur].iov_len = w->pos - pool[w->cur];
+  struct iovec *iov = w->iov;
+  while (cnt > 0 && !w->failed)
+  {
+    ssize_t r = writev(w->fd, iov, cnt);
+    if (r < 0)
+    {
+      w->failed = errno != EINTR;
+      continue;
+    }
+    w->written += r;
+    while (cnt > 0 && (size_t)r >= iov->iov_len)
+    {
+      r -= iov->iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0)
+    {
+      iov->iov_base = (char *)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+  w->cur = 0;
+  w->pos = pool[0];
+  w->end = pool[0] + WRITE_CHUNK;
+}
+
+// Makes room for one token, moving on to the next chunk or flushing
+void _write_reserve(writer *w)
+{
+  if (w->end - w->pos >= TOKEN_MAX)
+  {
+    return;
+  }
+  if (w->cur == WRITE_BATCH - 1)
+  {
+    _write_flush(w);
+    return;
+  }
+  int next = w->cur + 1;
+  if (!pool[next] && !(pool[next] = (char *)nremalloc(NULL, WRITE_CHUNK)))
+  {
+    // Out of memory (ERR_RETURN): make do with the chunks already held
+    _write_flush(w);
+    return;
+  }
+  w->iov[w->cur].iov_base = pool[w->cur];
+  w->iov[w->cur].iov_len = w->pos - pool[w->cur];
+  w->cur++;
+  w->pos = pool[w->cur];
+  w->end = pool[w->cur] + WRITE_CHUNK;
+}
+
+void _write_atom(writer *w, atomtype a)
+{
+  char digits[TOKEN_MAX];
+  int n = 0;
+  long long v = a;
+  bool is_neg = v < 0;
+  unsigned long long u = is_neg ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+  do
+  {
+    digits[n++] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u);
+  _write_reserve(w);
+  if (is_neg)
+  {
+    *w->pos++ = '-';
+  }
+  while (n > 0)
+  {
+    *w->pos++ = digits[--n];
+  }
+}
+
+// Same layout as lisp_tostring(), without its length limit
+void _write_list(writer *w, const lisp *l)
+{
+  if (lisp_isatomic(l))
+  {
+    _write_atom(w, lisp_getval(l));
+    return;
+  }
+  _write_reserve(w);
+  *w->pos++ = LIST_BGN;
+  for (const lisp *h = l; h && !w->failed; h = lisp_cdr(h))
+  {
+    if (h != l)
+    {
+      _write_reserve(w);
+      *w->pos++ = SEP;
+    }
+    _write_list(w, h->car);
+  }
+  _write_reserve(w);
+  *w->pos++ = LIST_END;
+}
@@ -0,0 +1,346 @@
+#include "../ralist.h"
+#include "specific.h"
+
+#define VALSINIT 64
+
+// Reference counts are the only fields written after construction,
+// so they are updated atomically and everything else is read freely
+#define REF_INC(P) __atomic_add_fetch(&(P)->refs, 1, __ATOMIC_RELAXED)
+#define REF_DEC(P) __atomic_sub_fetch(&(P)->refs, 1, __ATOMIC_ACQ_REL)
+
+tree *_tree_new(atomtype v, tree *l, tree *r);
+tree *_tree_share(tree *t);
+void _tree_release(tree *t);
+tree *_tree_set(const tree *t, int size, int i, atomtype v);
+void _tree_collect(const tree *t, atomtype *vals, int *k);
+ralist *_spine_new(int size, tree *root, ralist *next);
+ralist *_spine_set(const ralist *s, int i, atomtype v);
+atomtype *_collect(const ralist *r);
+bool _flatten(const lisp *l, atomtype **vals, int *n, int *cap);
+ralist *_fromvals(const atomtype *vals, int n, ralist *tail);
+
+// Takes over the references to 'l' and 'r', dropping them
+// if out of memory (ERR_RETURN)
+tree *_tree_new(atomtype v, tree *l, tree *r)
+{
+  tree *t = (tree *)ncalloc(1, sizeof(tree));
+  if (!t)
+  {
+    _tree_release(l);
+    _tree_release(r);
+    return NULL;
+  }
+  t->refs = 1;
+  t->val = v;
+  t->l = l;
+  t->r = r;
+  return t;
+}
+
+tree *_tree_share(tree *t)
+{
+  if (t)
+  {
+    REF_INC(t);
+  }
+  return t;
+}
+
+void _tree_release(tree *t)
+{
+  if (!t || REF_DEC(t) > 0)
+  {
+    return;
+  }
+  // Trees are balanced, so recursion is only O(log n) deep
+  _tree_release(t->l);
+  _tree_release(t->r);
+  free(t);
+}
+
+// Takes over the references to 'root' and 'next', dropping them
+// if out of memory. A NULL 'root' is a failed _tree_new(), passed on
+ralist *_spine_new(int size, tree *root, ralist *next)
+{
+  ralist *s = root ? (ralist *)ncalloc(1, sizeof(ralist)) : NULL;
+  if (!s)
+  {
+    _tree_release(root);
+    ralist_free(&next);
+    return NULL;
+  }
+  s->refs = 1;
+  s->size = size;
+  s->len = size + (next ? next->len : 0);
+  s->root = root;
+  s->next = next;
+  return s;
+}
+
+ralist *ralist_share(const ralist *r)
+{
+  ralist *s = (ralist *)r;
+  if (s)
+  {
+    REF_INC(s);
+  }
+  return s;
+}
+
+void ralist_free(ralist **r)
+{
+  ralist *s = *r;
+  // Walk the spine iteratively, it may be shared from any point on
+  while (s && REF_DEC(s) == 0)
+  {
+    ralist *next = s->next;
+    _tree_release(s->root);
+    free(s);
+    s = next;
+  }
+  *r = NULL;
+}
+
+int ralist_length(const ralist *r)
+{
+  return r ? r->len : 0;
+}
+
+ralist *ralist_push(const ralist *r, atomtype v)
+{
+  bool is_merge = r && r->next && r->size == r->next->size;
+  if (is_merge)
+  {
+    tree *t = _tree_new(v, _tree_share(r->root), _tree_share(r->next->root));
+    return _spine_new(1 + 2 * r->size, t, ralist_share(r->next->next));
+  }
+  return _spine_new(1, _tree_new(v, NULL, NULL), ralist_share(r));
+}
+
+ralist *ralist_pop(const ralist *r)
+{
+  if (!r)
+  {
+    return NULL;
+  }
+  if (r->size == 1)
+  {
+    return ralist_share(r->next);
+  }
+  int half = r->size / 2;
+  ralist *rest = _spine_new(half, _tree_share(r->root->r), ralist_share(r->next));
+  if (!rest)
+  {
+    return NULL;
+  }
+  return _spine_new(half, _tree_share(r->root->l), rest);
+}
+
+bool ralist_get(const ralist *r, int i, atomtype *v)
+{
+  if (!v || i < 0)
+  {
+    return false;
+  }
+  const ralist *s = r;
+  while (s && i >= s->size)
+  {
+    i -= s->size;
+    s = s->next;
+  }
+  if (!s)
+  {
+    return false;
+  }
+  const tree *t = s->root;
+  int size = s->size;
+  while (i > 0)
+  {
+    int half = size / 2;
+    if (i <= half)
+    {
+      t = t->l;
+      i -= 1;
+    }
+    else
+    {
+      t = t->r;
+      i -= 1 + half;
+    }
+    size = half;
+  }
+  *v = t->val;
+  return true;
+}
+
+ralist *ralist_set(const ralist *r, int i, atomtype v)
+{
+  if (i < 0 || i >= ralist_length(r))
+  {
+    return ralist_share(r);
+  }
+  return _spine_set(r, i, v);
+}
+
+// Copies the spine up to the tree holding 'i', shares the rest
+ralist *_spine_set(const ralist *s, int i, atomtype v)
+{
+  if (i < s->size)
+  {
+    tree *t = _tree_set(s->root, s->size, i, v);
+    return _spine_new(s->size, t, ralist_share(s->next));
+  }
+  ralist *next = _spine_set(s->next, i - s->size, v);
+  if (!next)
+  {
+    return NULL;
+  }
+  return _spine_new(s->size, _tree_share(s->root), next);
+}
+
+// Copies the path from the root down to 'i', shares the rest
+tree *_tree_set(const tree *t, int size, int i, atomtype v)
+{
+  if (i == 0)
+  {
+    return _tree_new(v, _tree_share(t->l), _tree_share(t->r));
+  }
+  int half = size / 2;
+  bool is_left = i <= half;
+  tree *sub = is_left ? _tree_set(t->l, half, i - 1, v) : _tree_set(t->r, half, i - 1 - half, v);
+  if (!sub)
+  {
+    return NULL;
+  }
+  if (is_left)
+  {
+    return _tree_new(t->val, sub, _tree_share(t->r));
+  }
+  return _tree_new(t->val, _tree_share(t->l), sub);
+}
+
+void _tree_collect(const tree *t, atomtype *vals, int *k)
+{
+  if (!t)
+  {
+    return;
+  }
+  vals[(*k)++] = t->val;
+  _tree_collect(t->l, vals, k);
+  _tree_collect(t->r, vals, k);
+}
+
+// Returns all elements in order, the caller frees the array
+atomtype *_collect(const ralist *r)
+{
+  atomtype *vals = (atomtype *)ncalloc(ralist_length(r) + 1, sizeof(atomtype));
+  if (!vals)
+  {
+    return NULL;
+  }
+  int k = 0;
+  for (const ralist *s = r; s; s = s->next)
+  {
+    _tree_collect(s->root, vals, &k);
+  }
+  return vals;
+}
+
+// Pushes 'vals' in front of 'tail', taking over its reference
+ralist *_fromvals(const atomtype *vals, int n, ralist *tail)
+{
+  ralist *acc = tail;
+  for (int i = n - 1; i >= 0; i--)
+  {
+    ralist *next = ralist_push(acc, vals[i]);
+    ralist_free(&acc);
+    if (!next)
+    {
+      return NULL;
+    }
+    acc = next;
+  }
+  return acc;
+}
+
+ralist *ralist_concat(const ralist *a, const ralist *b)
+{
+  atomtype *vals = _collect(a);
+  if (!vals)
+  {
+    return NULL;
+  }
+  ralist *acc = _fromvals(vals, ralist_length(a), ralist_share(b));
+  free(vals);
+  return acc;
+}
+
+bool _flatten(const lisp *l, atomtype **vals, int *n, int *cap)
+{
+  if (!l)
+  {
+    return true;
+  }
+  if (lisp_isatomic(l))
+  {
+    if (*n == *cap)
+    {
+      atomtype *more = (atomtype *)nremalloc(*vals, *cap * 2 * sizeof(atomtype));
+      if (!more)
+      {
+        return false;
+      }
+      *vals = more;
+      *cap *= 2;
+    }
+    (*vals)[(*n)++] = lisp_getval(l);
+    return true;
+  }
+  for (const lisp *h = l; h; h = lisp_cdr(h))
+  {
+    if (!_flatten(lisp_car(h), vals, n, cap))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+ralist *ralist_fromlisp(const lisp *l)
+{
+  int n = 0;
+  int cap = VALSINIT;
+  atomtype *vals = (atomtype *)ncalloc(cap, sizeof(atomtype));
+  if (!vals)
+  {
+    return NULL;
+  }
+  ralist *acc = _flatten(l, &vals, &n, &cap) ? _fromvals(vals, n, NULL) : NULL;
+  free(vals);
+  return acc;
+}
+
+lisp *ralist_tolisp(const ralist *r)
+{
+  int n = ralist_length(r);
+  atomtype *vals = _collect(r);
+  if (!vals)
+  {
+    return NULL;
+  }
+  lisp *l = NULL;
+  for (int i = n - 1; i >= 0; i--)
+  {
+    lisp *a = lisp_atom(vals[i]);
+    lisp *next = a ? lisp_cons(a, l) : NULL;
+    if (!next)
+    {
+      lisp_free(&a);
+      lisp_free(&l);
+      break;
+    }
+    l = next;
+  }
+  free(vals);
+  return l;
+}
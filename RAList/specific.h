@@ -0,0 +1,24 @@
+#pragma once
+
+#define RALISTIMPL "SkewBinary"
+
+// Complete binary tree holding its elements in preorder
+typedef struct tree
+{
+  int refs;
+  atomtype val;
+  struct tree *l;
+  struct tree *r;
+} tree;
+
+// Skew-binary spine: tree sizes are 2^k - 1 and increase along 'next',
+// only the first two may be equal
+struct ralist
+{
+  int refs;
+  int size;
+  // Number of elements in this and all later trees
+  int len;
+  tree *root;
+  struct ralist *next;
+};
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "eval.h"
+
+#define LOOPS 1000000
+#define LOOPSTR "1000000"
+#define WALK 1000000
+
+/* Runs the same counting loop through lisp_interp(), walking the
+   program's list, and through lisp_compile() + lisp_run(), then a
+   loop that walks a list of WALK atoms one CDR at a time */
+
+double now(void);
+void walk(void);
+
+int main(void)
+{
+   /* A = 0; B = 0; C = (1 2 3);
+      while (A < LOOPS) { B = B + length(C); A = A + 1; } */
+   lisp *l = lisp_fromstring("((11 0 (1 0)) (11 1 (1 0)) (11 2 (1 (1 2 3))) "
+                             "(13 (10 (3 0) (1 " LOOPSTR ")) "
+                             "((11 1 (7 (3 1) (8 (3 2)))) (11 0 (7 (3 0) (1 1))))))");
+   assert(l);
+   printf("Bench Eval (%d loop iterations) Start ...\n", LOOPS);
+
+   lisp_env walked;
+   lisp_env_init(&walked);
+   double bgn = now();
+   bool ok = lisp_interp(l, &walked);
+   double t1 = now() - bgn;
+   assert(ok);
+   (void)ok;
+
+   lisp_env ran;
+   lisp_env_init(&ran);
+   bgn = now();
+   lisp_prog *p = lisp_compile(l);
+   lisp_run(p, &ran);
+   double t2 = now() - bgn;
+
+   assert(lisp_getval(walked.vars[1]) == 3 * LOOPS);
+   assert(lisp_getval(ran.vars[1]) == 3 * LOOPS);
+   printf("lisp_interp             : %8.2f ms\n", t1 * 1000);
+   printf("lisp_compile + lisp_run : %8.2f ms (%.1fx)\n", t2 * 1000, t1 / t2);
+
+   lisp_prog_free(&p);
+   lisp_env_free(&walked);
+   lisp_env_free(&ran);
+   lisp_free(&l);
+   walk();
+   lisp_cache_trim();
+   return 0;
+}
+
+// Reading a variable does not copy it, so each step costs O(1)
+void walk(void)
+{
+   /* B = 0; while (A) { B = B + car(A); A = cdr(A); } */
+   lisp *l = lisp_fromstring("((11 1 (1 0)) (13 (3 0) "
+                             "((11 1 (7 (3 1) (4 (3 0)))) (11 0 (5 (3 0))))))");
+   assert(l);
+   printf("Bench Eval (walking a list of %d) Start ...\n", WALK);
+   lisp_env walked, ran;
+   lisp_env_init(&walked);
+   lisp_env_init(&ran);
+   walked.vars[0] = lisp_range(-WALK / 2, WALK / 2, 1);
+   ran.vars[0] = lisp_range(-WALK / 2, WALK / 2, 1);
+   // Generate both lists up front, so only the walk is timed
+   int n1 = lisp_length(walked.vars[0]);
+   int n2 = lisp_length(ran.vars[0]);
+   assert(n1 == WALK && n2 == WALK);
+   (void)n1;
+   (void)n2;
+
+   double bgn = now();
+   bool ok = lisp_interp(l, &walked);
+   double t1 = now() - bgn;
+   assert(ok);
+   (void)ok;
+   bgn = now();
+   lisp_prog *p = lisp_compile(l);
+   lisp_run(p, &ran);
+   double t2 = now() - bgn;
+
+   assert(walked.vars[0] == NULL && lisp_getval(walked.vars[1]) == -WALK / 2);
+   assert(ran.vars[0] == NULL && lisp_getval(ran.vars[1]) == -WALK / 2);
+   printf("lisp_interp             : %8.2f ms\n", t1 * 1000);
+   printf("lisp_compile + lisp_run : %8.2f ms (%.1fx)\n", t2 * 1000, t1 / t2);
+
+   lisp_prog_free(&p);
+   lisp_env_free(&walked);
+   lisp_env_free(&ran);
+   lisp_free(&l);
+}
+
+double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <assert.h>
+#include "general.h"
+
+#define GRIDMAX 2048
+#define GRIDSTEP 32
+#define BUFMAX 1000000
+// The old nrecalloc() copies the whole buffer on every call
+#define OLDBUFMAX 20000
+
+/* Grows a grid of ints GRIDSTEP rows and columns at a time up to
+   GRIDMAX x GRIDMAX, then a 1D buffer one element at a time,
+   with the per-row helpers against the contiguous/geometric ones.
+   The 1D buffer is also grown with a copy of the calloc() + memcpy()
+   nrecalloc() that the realloc() one replaced, at a size it can manage. */
+
+double now(void);
+void fill(int** g, int h, int w);
+long check(int** g, int h, int w);
+void* old_nrecalloc(void* p, int oldbytes, int newbytes);
+double grow_old(int n);
+double grow_nrecalloc(int n);
+double grow_nbuf(int n);
+
+int main(void)
+{
+   double bgn;
+   int h;
+   int** g;
+   long expected;
+
+   printf("Bench General Start ...\n");
+
+   bgn = now();
+   g = (int**)n2dcalloc(GRIDSTEP, GRIDSTEP, sizeof(int));
+   fill(g, GRIDSTEP, GRIDSTEP);
+   for(h=GRIDSTEP; h<GRIDMAX; h+=GRIDSTEP){
+      g = (int**)n2drecalloc((void**)g, h, h+GRIDSTEP, h, h+GRIDSTEP, sizeof(int));
+   }
+   expected = check(g, GRIDMAX, GRIDMAX);
+   n2dfree((void**)g, GRIDMAX);
+   printf("grid  n2drecalloc        : %8.2f ms\n", (now()-bgn)*1000);
+
+   bgn = now();
+   g = (int**)n2dcalloc_contig(GRIDSTEP, GRIDSTEP, sizeof(int));
+   fill(g, GRIDSTEP, GRIDSTEP);
+   for(h=GRIDSTEP; h<GRIDMAX; h+=GRIDSTEP){
+      g = (int**)n2drecalloc_contig((void**)g, h, h+GRIDSTEP, h, h+GRIDSTEP, sizeof(int));
+   }
+   assert(check(g, GRIDMAX, GRIDMAX)==expected);
+   g = (int**)n2drecalloc_contig((void**)g, GRIDMAX, GRIDSTEP, GRIDMAX, GRIDSTEP, sizeof(int));
+   assert(check(g, GRIDSTEP, GRIDSTEP)==expected);
+   n2dfree_contig((void**)g);
+   printf("grid  n2drecalloc_contig : %8.2f ms\n", (now()-bgn)*1000);
+
+   printf("1D    old nrecalloc      : %8.2f ms (%d ints)\n", grow_old(OLDBUFMAX), OLDBUFMAX);
+   printf("1D    nrecalloc          : %8.2f ms (%d ints)\n", grow_nrecalloc(OLDBUFMAX), OLDBUFMAX);
+   printf("1D    nbuf_resize        : %8.2f ms (%d ints)\n", grow_nbuf(OLDBUFMAX), OLDBUFMAX);
+   printf("1D    nrecalloc          : %8.2f ms (%d ints)\n", grow_nrecalloc(BUFMAX), BUFMAX);
+   printf("1D    nbuf_resize        : %8.2f ms (%d ints)\n", grow_nbuf(BUFMAX), BUFMAX);
+   return 0;
+}
+
+// nrecalloc() as it was before it used realloc()
+void* old_nrecalloc(void* p, int oldbytes, int newbytes)
+{
+   void* n = calloc(newbytes, 1);
+   if(n==NULL){
+      on_error("Cannot calloc() space");
+      return NULL;
+   }
+   memcpy(n, p, oldbytes);
+   free(p);
+   return n;
+}
+
+// Each grow_*() appends 'n' ints one at a time, returning the ms taken
+double grow_old(int n)
+{
+   double bgn = now();
+   int* v = NULL;
+   for(int i=0; i<n; i++){
+      v = (int*)old_nrecalloc(v, i*sizeof(int), (i+1)*sizeof(int));
+      v[i] = i;
+   }
+   free(v);
+   return (now()-bgn)*1000;
+}
+
+double grow_nrecalloc(int n)
+{
+   double bgn = now();
+   int* v = NULL;
+   for(int i=0; i<n; i++){
+      v = (int*)nrecalloc(v, i*sizeof(int), (i+1)*sizeof(int));
+      v[i] = i;
+   }
+   free(v);
+   return (now()-bgn)*1000;
+}
+
+double grow_nbuf(int n)
+{
+   double bgn = now();
+   nbuf b;
+   nbuf_init(&b, sizeof(int));
+   for(int i=0; i<n; i++){
+      int* d = (int*)nbuf_resize(&b, i+1);
+      d[i] = i;
+   }
+   assert(((int*)b.data)[n-1]==n-1);
+   nbuf_free(&b);
+   return (now()-bgn)*1000;
+}
+
+void fill(int** g, int h, int w)
+{
+   for(int j=0; j<h; j++){
+      for(int i=0; i<w; i++){
+         g[j][i] = j*w+i;
+      }
+   }
+}
+
+long check(int** g, int h, int w)
+{
+   long sum = 0;
+   for(int j=0; j<h; j++){
+      for(int i=0; i<w; i++){
+         sum += g[j][i];
+      }
+   }
+   return sum;
+}
+
+double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (double)ts.tv_nsec/1e9;
+}
@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "lisp.h"
+
+#define LISTSTRLEN 1000
+#define NLISTS 1000000
+#define BATCH 4096
+#define TMPFS "/dev/shm/benchwrite.lsp"
+#define FALLBACK "benchwrite.lsp"
+
+/* Writes NLISTS lists to a tmpfs file, once with the
+   lisp_tostring() + fputs() loop, once with lisp_write_file() */
+
+double now(void);
+long run_tostring(FILE *fp, lisp **ls);
+long run_write(FILE *fp, lisp **ls);
+
+int main(void)
+{
+   char *templates[4] = {"(1 2 3 4)", "(0 (1 -2) 3 4 50)", "((-1 2) (3 4) (5 (6 7)))",
+                         "(3 (4) (3 (55 3) (2 4 (3) (3 (44 12)))))"};
+   lisp **ls = (lisp **)ncalloc(NLISTS, sizeof(lisp *));
+   for (int i = 0; i < NLISTS; i++)
+   {
+      ls[i] = lisp_fromstring(templates[i % 4]);
+   }
+   char *fname = TMPFS;
+   FILE *fp = fopen(fname, "w");
+   if (!fp)
+   {
+      fname = FALLBACK;
+      fp = nfopen(fname, "w");
+   }
+   printf("Bench Write (%d lists to %s) Start ...\n", NLISTS, fname);
+
+   double bgn = now();
+   long b1 = run_tostring(fp, ls);
+   double t1 = now() - bgn;
+   rewind(fp);
+   bgn = now();
+   long b2 = run_write(fp, ls);
+   double t2 = now() - bgn;
+   assert(b1 == b2);
+   printf("lisp_tostring + fputs : %8.2f ms %8.1f MB/s\n", t1 * 1000, b1 / t1 / 1e6);
+   printf("lisp_write_file       : %8.2f ms %8.1f MB/s\n", t2 * 1000, b2 / t2 / 1e6);
+
+   fclose(fp);
+   remove(fname);
+   for (int i = 0; i < NLISTS; i++)
+   {
+      lisp_free(&ls[i]);
+   }
+   free(ls);
+   lisp_write_release();
+   lisp_cache_flush();
+   lisp_cache_trim();
+   return 0;
+}
+
+long run_tostring(FILE *fp, lisp **ls)
+{
+   char str[LISTSTRLEN];
+   long bytes = 0;
+   for (int i = 0; i < NLISTS; i++)
+   {
+      lisp_tostring(ls[i], str);
+      fputs(str, fp);
+      fputc('\n', fp);
+      bytes += strlen(str) + 1;
+   }
+   fflush(fp);
+   return bytes;
+}
+
+long run_write(FILE *fp, lisp **ls)
+{
+   long bytes = 0;
+   for (int i = 0; i < NLISTS; i += BATCH)
+   {
+      int n = NLISTS - i < BATCH ? NLISTS - i : BATCH;
+      bytes += lisp_write_file(fp, (const lisp **)ls + i, n);
+   }
+   return bytes;
+}
+
+double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,16 @@
+; S-expressions replayed by profilelisp, one per line, ';' starts a comment
+; Small lists, as in testlisp.c
+(1 2 3 4)
+(0 (1 -2) 3 4 50)
+((-1 2) (3 4) (5 (6 7)))
+(3 (4) (3 (55 3) (2 4 (3) (3 (44 12)))))
+(1)
+(-123456 7890 42)
+; A long flat list
+(0 7 14 21 28 35 42 49 56 63 70 77 84 91 98 105 112 119 126 133 140 147 154 161 168 175 182 189 196 203 210 217 224 231 238 245 252 259 266 273 280 287 294 301 308 315 322 329 336 343 350 357 364 371 378 385 392 399 406 413 420 427 434 441 448 455 462 469 476 483 490 497 504 511 518 525 532 539 546 553 560 567 574 581 588 595 602 609 616 623 630 637 644 651 658 665 672 679 686 693)
+; Wide: many short sublists
+((0 0) (1 -1) (2 -2) (3 -3) (4 -4) (5 -5) (6 -6) (7 -7) (8 -8) (9 -9) (10 -10) (11 -11) (12 -12) (13 -13) (14 -14) (15 -15) (16 -16) (17 -17) (18 -18) (19 -19) (20 -20) (21 -21) (22 -22) (23 -23) (24 -24) (25 -25) (26 -26) (27 -27) (28 -28) (29 -29) (30 -30) (31 -31) (32 -32) (33 -33) (34 -34) (35 -35) (36 -36) (37 -37) (38 -38) (39 -39))
+; Deep right nesting
+(0 (1 (2 (3 (4 (5 (6 (7 (8 (9 (10 (11 (12 (13 (14 (15 (16 (17 (18 (19 (20 (21 (22 (23 (24 (25 (26 (27 (28 (29 0))))))))))))))))))))))))))))))
+; Deep left nesting
+((((((((((((((((((((((((((((((0 0) 1) 2) 3) 4) 5) 6) 7) 8) 9) 10) 11) 12) 13) 14) 15) 16) 17) 18) 19) 20) 21) 22) 23) 24) 25) 26) 27) 28) 29)
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "lisp.h"
+
+#define LISP_NVARS 26
+
+/* Programs are themselves lists, as used by NUCLEI, with an integer
+   operator code as the car of every instruction and expression.
+   A program (and every then/else/body block) is a list of instructions:
+     (LISP_OP_SET var expr)
+     (LISP_OP_IF expr (then instructions) (else instructions))
+     (LISP_OP_WHILE expr (body instructions))
+   and expressions are:
+     (LISP_OP_QUOTE l)  (LISP_OP_NIL)  (LISP_OP_VAR var)
+     (LISP_OP_CAR expr)  (LISP_OP_CDR expr)  (LISP_OP_LENGTH expr)
+     (LISP_OP_CONS expr expr)  (LISP_OP_PLUS expr expr)
+     (LISP_OP_EQUAL expr expr)  (LISP_OP_LESS expr expr)
+   where var is 0 to LISP_NVARS - 1. Tests take an atom as true when
+   non-zero and a list when non-empty, EQUAL and LESS return 1 or 0.
+   Variables and literals are read in place: CAR and CDR cost O(1), and
+   storing a part of a variable back into it frees the rest, so walking
+   a list with (SET 0 (CDR (VAR 0))) is linear. Storing a part of another
+   variable or a literal, or CONS of one, copies that part. */
+typedef enum lisp_op
+{
+  LISP_OP_QUOTE = 1,
+  LISP_OP_NIL,
+  LISP_OP_VAR,
+  LISP_OP_CAR,
+  LISP_OP_CDR,
+  LISP_OP_CONS,
+  LISP_OP_PLUS,
+  LISP_OP_LENGTH,
+  LISP_OP_EQUAL,
+  LISP_OP_LESS,
+  LISP_OP_SET,
+  LISP_OP_IF,
+  LISP_OP_WHILE
+} lisp_op;
+
+// Variables of a running program, every value is owned by the env
+typedef struct lisp_env
+{
+  lisp *vars[LISP_NVARS];
+} lisp_env;
+
+// A program compiled to bytecode
+typedef struct lisp_prog lisp_prog;
+
+void lisp_env_init(lisp_env *env);
+
+// Frees every variable's value
+void lisp_env_free(lisp_env *env);
+
+// Compiles 'program' once for any number of lisp_run() calls.
+// Literals are copied, so 'program' may be freed afterwards.
+// Returns NULL if 'program' is malformed
+lisp_prog *lisp_compile(const lisp *program);
+
+// Runs 'p' on the bytecode VM, reading and updating 'env'
+void lisp_run(const lisp_prog *p, lisp_env *env);
+
+void lisp_prog_free(lisp_prog **p);
+
+// Runs 'program' by walking its list directly, as a reference for
+// lisp_run(). Returns false if 'program' is malformed
+bool lisp_interp(const lisp *program, lisp_env *env);
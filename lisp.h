@@ -11,6 +11,18 @@ typedef int atomtype;
 #include <assert.h>
 #include <stdarg.h>
 
+/* Lists may be built and freed concurrently from any number of threads,
+   as long as no two threads use the same list at the same time.
+   Freed nodes are cached per thread, see lisp_cache_flush().
+   In ERR_RETURN mode (see general.h) running out of memory makes
+   lisp_atom(), lisp_cons(), lisp_copy(), lisp_fromstring() and
+   lisp_list() return NULL instead of exiting, having freed any
+   partly built list. A lazy cell that cannot be forced reads as the
+   end of its list and is forced again on the next visit.
+   The deferred reclaim queue and collector mode are per thread: a
+   thread in collector mode must keep its lists to itself, other
+   threads carry on with their own caches */
+
 // Returns element 'a' - this is not a list, and
 // by itself would be printed as e.g. "3", and not "(3)"
 lisp *lisp_atom(const atomtype a);
@@ -28,6 +40,64 @@ lisp *lisp_car(const lisp *l);
 // Does not copy any data.
 lisp *lisp_cdr(const lisp *l);
 
+// The c[ad]{2,4}r compositions e.g. lisp_caddr(L) is
+// lisp_car(lisp_cdr(lisp_cdr(L))), listed in the order of their names
+#define lisp_caar(L) lisp_car(lisp_car(L))
+#define lisp_cadr(L) lisp_car(lisp_cdr(L))
+#define lisp_cdar(L) lisp_cdr(lisp_car(L))
+#define lisp_cddr(L) lisp_cdr(lisp_cdr(L))
+#define lisp_caaar(L) lisp_car(lisp_car(lisp_car(L)))
+#define lisp_caadr(L) lisp_car(lisp_car(lisp_cdr(L)))
+#define lisp_cadar(L) lisp_car(lisp_cdr(lisp_car(L)))
+#define lisp_caddr(L) lisp_car(lisp_cdr(lisp_cdr(L)))
+#define lisp_cdaar(L) lisp_cdr(lisp_car(lisp_car(L)))
+#define lisp_cdadr(L) lisp_cdr(lisp_car(lisp_cdr(L)))
+#define lisp_cddar(L) lisp_cdr(lisp_cdr(lisp_car(L)))
+#define lisp_cdddr(L) lisp_cdr(lisp_cdr(lisp_cdr(L)))
+#define lisp_caaaar(L) lisp_car(lisp_car(lisp_car(lisp_car(L))))
+#define lisp_caaadr(L) lisp_car(lisp_car(lisp_car(lisp_cdr(L))))
+#define lisp_caadar(L) lisp_car(lisp_car(lisp_cdr(lisp_car(L))))
+#define lisp_caaddr(L) lisp_car(lisp_car(lisp_cdr(lisp_cdr(L))))
+#define lisp_cadaar(L) lisp_car(lisp_cdr(lisp_car(lisp_car(L))))
+#define lisp_cadadr(L) lisp_car(lisp_cdr(lisp_car(lisp_cdr(L))))
+#define lisp_caddar(L) lisp_car(lisp_cdr(lisp_cdr(lisp_car(L))))
+#define lisp_cadddr(L) lisp_car(lisp_cdr(lisp_cdr(lisp_cdr(L))))
+#define lisp_cdaaar(L) lisp_cdr(lisp_car(lisp_car(lisp_car(L))))
+#define lisp_cdaadr(L) lisp_cdr(lisp_car(lisp_car(lisp_cdr(L))))
+#define lisp_cdadar(L) lisp_cdr(lisp_car(lisp_cdr(lisp_car(L))))
+#define lisp_cdaddr(L) lisp_cdr(lisp_car(lisp_cdr(lisp_cdr(L))))
+#define lisp_cddaar(L) lisp_cdr(lisp_cdr(lisp_car(lisp_car(L))))
+#define lisp_cddadr(L) lisp_cdr(lisp_cdr(lisp_car(lisp_cdr(L))))
+#define lisp_cdddar(L) lisp_cdr(lisp_cdr(lisp_cdr(lisp_car(L))))
+#define lisp_cddddr(L) lisp_cdr(lisp_cdr(lisp_cdr(lisp_cdr(L))))
+
+// A compiled c[ad]+r accessor, see lisp_path_compile()
+#define LISP_PATHMAX 30
+typedef struct lisp_path
+{
+  // Bit i set means step i is a car, steps are applied right to left
+  unsigned int ops;
+  // Number of steps, -1 if the spec was invalid
+  int len;
+} lisp_path;
+
+// Compiles a spec such as "caddr" into a reusable accessor.
+// Specs are "c", 1 to LISP_PATHMAX of 'a'/'d', then "r"
+lisp_path lisp_path_compile(const char *spec);
+
+// Applies the accessor 'p' to 'l'. Does not copy any data
+lisp *lisp_path_get(const lisp *l, lisp_path p);
+
+// Fills out[i] with lisp_path_get(l, paths[i]) for all 'n' paths.
+// Steps shared with the previous path are not walked again,
+// so order paths to share their rightmost letters e.g. cadr, caddr, cadddr
+void lisp_extract(const lisp *l, const lisp_path *paths, int n, lisp **out);
+
+// Returns the part of '*l' reached by 'p', freeing all the rest and setting
+// '*l' to NULL. Only the cells on the path and what hangs off them are visited.
+// In collector mode no cell is changed and '*l' is only dropped as a root
+lisp *lisp_path_take(lisp **l, lisp_path p);
+
 // Returns the data/value stored in the cons 'l'
 atomtype lisp_getval(const lisp *l);
 
@@ -47,6 +117,120 @@ void lisp_tostring(const lisp *l, char *str);
 // Double pointer allows function to set 'l' to NULL on success
 void lisp_free(lisp **l);
 
+// Detaches 'l' in O(1) and queues it for deferred reclamation,
+// setting 'l' to NULL. Nodes are released by lisp_gc_step()/lisp_gc_drain().
+// If no node is left to queue it with (ERR_RETURN), 'l' is freed at once
+void lisp_free_async(lisp **l);
+
+// Reclaims queued nodes, doing at most 'budget' units of work.
+// Returns the number of nodes freed by this call
+int lisp_gc_step(int budget);
+
+// Reclaims everything still queued by lisp_free_async() e.g. at shutdown.
+// Returns the number of nodes freed
+int lisp_gc_drain(void);
+
+// Optional tracing collector. Between lisp_heap_begin() and lisp_heap_end()
+// the calling thread's lisp_atom()/lisp_cons() take nodes from its own
+// collector pool, so shared and cyclic lists are safe, and its lisp_free()
+// only drops a root. Both calls must come from the same thread.
+// Lists built outside collector mode must not be mixed with its lists.
+typedef struct lisp_heapconf
+{
+  // Nodes per slab added whenever the pool runs dry
+  int slab_nodes;
+  // Allocations after which lisp_heap_poll() collects
+  int threshold;
+} lisp_heapconf;
+
+typedef struct lisp_heapstats
+{
+  int collections;
+  // Nodes allocated and not yet reclaimed / nodes held in all slabs
+  long live;
+  long heap;
+  long freed_total;
+  // Wall-clock pause of the collections
+  double last_pause_ms;
+  double max_pause_ms;
+  double total_pause_ms;
+} lisp_heapstats;
+
+// Enters collector mode, 'conf' may be NULL (or zero fields) for defaults
+void lisp_heap_begin(const lisp_heapconf *conf);
+
+// Leaves collector mode, releasing every slab and all lists inside them
+void lisp_heap_end(void);
+
+// Registers/unregisters the variable 'root' whose list must stay alive.
+// lisp_free() on a registered variable also unregisters it.
+// addroot returns false if 'root' could not be registered (ERR_RETURN)
+bool lisp_heap_addroot(lisp **root);
+void lisp_heap_removeroot(lisp **root);
+
+// Marks from the roots and sweeps the slabs, returns nodes reclaimed.
+// Collections only happen here and in lisp_heap_poll(), so unrooted
+// temporaries are safe until then. If the mark stack cannot grow
+// (ERR_RETURN) nothing is reclaimed and 0 is returned
+int lisp_heap_collect(void);
+
+// Collects only once 'threshold' allocations happened since the last one
+int lisp_heap_poll(void);
+
+// Copies the collector statistics into 's'
+void lisp_heap_stats(lisp_heapstats *s);
+
+// Produces the next value of a lazy list into 'val',
+// returning false once the sequence is exhausted
+typedef bool (*lisp_gen)(void *state, atomtype *val);
+
+// Returns a lazy list of the values produced by 'generator'.
+// Each cdr is only generated when first visited with lisp_cdr() and
+// is then kept, so the list costs memory only for the part visited.
+// 'state' is not copied and must outlive the list
+lisp *lisp_lazy(lisp_gen generator, void *state);
+
+// Returns the lazy list a, a+step, ... stopping before 'b'
+// e.g. lisp_range(0, 6, 2) behaves as (0 2 4)
+lisp *lisp_range(atomtype a, atomtype b, atomtype step);
+
+// Hands the calling thread's cached nodes to the shared depot,
+// call it before a worker thread exits
+void lisp_cache_flush(void);
+
+// Returns every cached node to the system allocator, e.g. at shutdown
+void lisp_cache_trim(void);
+
+#ifdef LISP_PROFILE
+// Running allocation counts of the calling thread, see profilelisp.c
+typedef struct lisp_allocstats
+{
+  // Nodes handed out / given back by lisp_atom(), lisp_free() etc.
+  long nodes;
+  long releases;
+  // Calls into the system allocator: new nodes, slabs, parser scratch
+  long heap;
+} lisp_allocstats;
+
+// Only built with -DLISP_PROFILE
+lisp_allocstats lisp_prof_allocs(void);
+#endif
+
+// Writes the 'n' lists 'ls' to the file descriptor 'fd', one per line
+// laid out as by lisp_tostring() but without its length limit.
+// Lists are serialised into reusable per-thread buffers that are
+// flushed with writev() in large batches. Buffers are allocated as
+// output first needs them, running out (ERR_RETURN) only makes the batches smaller.
+// Returns the number of bytes written, or -1 on error
+long lisp_write_fd(int fd, const lisp **ls, int n);
+
+// As lisp_write_fd(), flushing 'fp' first and then writing to its descriptor
+long lisp_write_file(FILE *fp, const lisp **ls, int n);
+
+// Frees the calling thread's lisp_write_fd() buffers, call it
+// before a thread that wrote lists exits
+void lisp_write_release(void);
+
 // Builds a new list based on the string 'str'
 lisp *lisp_fromstring(const char *str);
 
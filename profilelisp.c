@@ -0,0 +1,266 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "lisp.h"
+
+#define LISTSTRLEN 1000
+// lisp_fromstring() may pad a line with spaces while parsing it
+#define LINEMAX (LISTSTRLEN / 2)
+#define MAXLINES 10000
+#define DEFCORPUS "corpus.lsp"
+#define DEFREPEAT 1000
+// Log-linear buckets: exact below 2^SUB_BITS ns, then 2^SUB_BITS
+// per power of two, so every value is within about 3%
+#define SUB_BITS 5
+#define SUB (1 << SUB_BITS)
+#define NBUCKETS (SUB * (64 - SUB_BITS + 1))
+
+/* Replays a corpus of S-expressions, one per line, through the public
+   lisp.h calls and reports latency percentiles and allocation counts
+   per operation. Built with -DLISP_PROFILE, see "make profile".
+   Usage: ./profilelisp [corpus] [repeats] */
+
+typedef enum op
+{
+   OP_FROMSTRING,
+   OP_COPY,
+   OP_LENGTH,
+   OP_TOSTRING,
+   OP_FREE,
+   OP_COUNT
+} op;
+
+typedef struct hist
+{
+   long counts[NBUCKETS];
+   long total;
+   unsigned long long max;
+   // Corpus line of the slowest call
+   int max_line;
+   long nodes;
+   long releases;
+   long heap;
+} hist;
+
+static const char *opnames[OP_COUNT] = {"lisp_fromstring", "lisp_copy", "lisp_length",
+                                        "lisp_tostring", "lisp_free"};
+
+// Times 'stmt' into 'h', charging allocations and releases
+// to it and the slowest call to 'line'
+#define PROFILE(h, line, stmt)                    \
+   do                                             \
+   {                                              \
+      lisp_allocstats a0 = lisp_prof_allocs();    \
+      unsigned long long t0 = now_ns();           \
+      stmt;                                       \
+      unsigned long long t = now_ns() - t0;       \
+      lisp_allocstats a1 = lisp_prof_allocs();    \
+      hist_record(h, t, line);                    \
+      (h)->nodes += a1.nodes - a0.nodes;          \
+      (h)->releases += a1.releases - a0.releases; \
+      (h)->heap += a1.heap - a0.heap;             \
+   } while (0)
+
+unsigned long long now_ns(void);
+int bucket_of(unsigned long long v);
+unsigned long long bucket_top(int b);
+void hist_record(hist *h, unsigned long long v, int line);
+unsigned long long hist_percentile(const hist *h, double p);
+int read_corpus(const char *fname, char **lines, int *linenos);
+void replay(char **lines, int *linenos, int n, hist *hs);
+void report(const hist *hs);
+void test_hist(void);
+
+int main(int argc, char *argv[])
+{
+   test_hist();
+   const char *fname = argc > 1 ? argv[1] : DEFCORPUS;
+   int repeat = argc > 2 ? atoi(argv[2]) : DEFREPEAT;
+   char **lines = (char **)ncalloc(MAXLINES, sizeof(char *));
+   int *linenos = (int *)ncalloc(MAXLINES, sizeof(int));
+   int n = read_corpus(fname, lines, linenos);
+   printf("Profile (%d expressions from %s, %d times) Start ...\n", n, fname, repeat);
+
+   hist *hs = (hist *)ncalloc(OP_COUNT, sizeof(hist));
+   for (int r = 0; r < repeat; r++)
+   {
+      replay(lines, linenos, n, hs);
+   }
+   report(hs);
+   lisp_allocstats a = lisp_prof_allocs();
+   printf("Nodes: %ld allocated, %ld released, %ld from the system allocator\n",
+          a.nodes, a.releases, a.heap);
+
+   for (int i = 0; i < n; i++)
+   {
+      free(lines[i]);
+   }
+   free(lines);
+   free(linenos);
+   free(hs);
+   lisp_cache_trim();
+   return 0;
+}
+
+// Keeps the lines lisp_fromstring() can take, warning about the rest
+int read_corpus(const char *fname, char **lines, int *linenos)
+{
+   FILE *fp = nfopen((char *)fname, "r");
+   char buf[LISTSTRLEN];
+   int n = 0;
+   int lineno = 0;
+   while (n < MAXLINES && fgets(buf, LISTSTRLEN, fp))
+   {
+      lineno++;
+      int len = strcspn(buf, "\r\n");
+      bool is_whole = buf[len] != '\0' || feof(fp);
+      buf[len] = '\0';
+      if (len == 0 || buf[0] == ';')
+      {
+         continue;
+      }
+      lisp *l = is_whole && len < LINEMAX ? lisp_fromstring(buf) : NULL;
+      if (!l)
+      {
+         fprintf(stderr, "%s:%d: skipped, too long or not a list\n", fname, lineno);
+         while (!is_whole && fgets(buf, LISTSTRLEN, fp) && !strchr(buf, '\n'))
+         {
+         }
+         continue;
+      }
+      lisp_free(&l);
+      lines[n] = (char *)ncalloc(len + 1, sizeof(char));
+      strcpy(lines[n], buf);
+      linenos[n] = lineno;
+      n++;
+   }
+   fclose(fp);
+   return n;
+}
+
+void replay(char **lines, int *linenos, int n, hist *hs)
+{
+   char str[LISTSTRLEN];
+   for (int i = 0; i < n; i++)
+   {
+      int line = linenos[i];
+      lisp *l, *c;
+      int len;
+      PROFILE(&hs[OP_FROMSTRING], line, l = lisp_fromstring(lines[i]));
+      PROFILE(&hs[OP_COPY], line, c = lisp_copy(l));
+      PROFILE(&hs[OP_LENGTH], line, len = lisp_length(c));
+      PROFILE(&hs[OP_TOSTRING], line, lisp_tostring(c, str));
+      PROFILE(&hs[OP_FREE], line, lisp_free(&c));
+      PROFILE(&hs[OP_FREE], line, lisp_free(&l));
+      assert(len >= 0);
+   }
+}
+
+void report(const hist *hs)
+{
+   printf("%-16s %9s %9s %9s %9s %9s %9s %9s %7s %6s\n", "operation (us)", "calls", "p50",
+          "p99", "p99.9", "max", "nodes/op", "freed/op", "heap/op", "worst");
+   for (int i = 0; i < OP_COUNT; i++)
+   {
+      const hist *h = &hs[i];
+      if (h->total == 0)
+      {
+         continue;
+      }
+      printf("%-16s %9ld %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %7.2f %6d\n", opnames[i],
+             h->total, hist_percentile(h, 0.5) / 1e3, hist_percentile(h, 0.99) / 1e3,
+             hist_percentile(h, 0.999) / 1e3, h->max / 1e3, (double)h->nodes / h->total,
+             (double)h->releases / h->total, (double)h->heap / h->total, h->max_line);
+   }
+}
+
+int bucket_of(unsigned long long v)
+{
+   if (v < SUB)
+   {
+      return (int)v;
+   }
+   int msb = 63 - __builtin_clzll(v);
+   int shift = msb - SUB_BITS;
+   return SUB + shift * SUB + (int)((v >> shift) - SUB);
+}
+
+// Highest value counted in bucket 'b'
+unsigned long long bucket_top(int b)
+{
+   if (b < SUB)
+   {
+      return b;
+   }
+   int shift = (b - SUB) / SUB;
+   unsigned long long m = (b - SUB) % SUB + SUB;
+   return ((m + 1) << shift) - 1;
+}
+
+void hist_record(hist *h, unsigned long long v, int line)
+{
+   h->counts[bucket_of(v)]++;
+   h->total++;
+   if (v > h->max)
+   {
+      h->max = v;
+      h->max_line = line;
+   }
+}
+
+unsigned long long hist_percentile(const hist *h, double p)
+{
+   long rank = (long)(p * h->total + 0.5);
+   rank = rank < 1 ? 1 : rank;
+   long seen = 0;
+   for (int b = 0; b < NBUCKETS; b++)
+   {
+      seen += h->counts[b];
+      if (seen >= rank)
+      {
+         unsigned long long top = bucket_top(b);
+         return top < h->max ? top : h->max;
+      }
+   }
+   return h->max;
+}
+
+unsigned long long now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void test_hist(void)
+{
+   for (unsigned long long v = 0; v < 100000; v++)
+   {
+      int b = bucket_of(v);
+      assert(b < NBUCKETS);
+      assert(v <= bucket_top(b));
+      assert(b == 0 || v > bucket_top(b - 1));
+   }
+   assert(bucket_of(~0ULL) == NBUCKETS - 1);
+   assert(bucket_top(NBUCKETS - 1) == ~0ULL);
+
+   hist *h = (hist *)ncalloc(1, sizeof(hist));
+   for (int i = 1; i <= 1000; i++)
+   {
+      hist_record(h, i, i);
+   }
+   assert(hist_percentile(h, 0.5) >= 500 && hist_percentile(h, 0.5) <= 515);
+   assert(hist_percentile(h, 0.999) >= 999);
+   assert(h->max == 1000 && h->max_line == 1000);
+   free(h);
+
+   lisp_allocstats a0 = lisp_prof_allocs();
+   lisp *l = lisp_fromstring("(1 (2 3) 4)");
+   lisp_allocstats a1 = lisp_prof_allocs();
+   // Four atoms, three top-level cells and two in the sublist
+   assert(a1.nodes - a0.nodes == 9);
+   // Freeing allocates nothing, its row must show the releases
+   h = (hist *)ncalloc(1, sizeof(hist));
+   PROFILE(h, 1, lisp_free(&l));
+   assert(h->nodes == 0 && h->releases == 9);
+   free(h);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "lisp.h"
+
+// A persistent random-access list of atoms (ralist).
+// The empty list is NULL. Every function returning a ralist* gives the
+// caller a new version to ralist_free(); versions share their nodes and
+// are never modified, so any thread may read a version it holds without
+// locks while other threads derive new versions from it.
+// In ERR_RETURN mode (see general.h) running out of memory makes these
+// return NULL, leaving their arguments untouched; last_error() tells
+// this apart from an empty result.
+typedef struct ralist ralist;
+
+// Returns another reference to the same version of 'r', O(1).
+// Use it to hand a snapshot to another thread
+ralist *ralist_share(const ralist *r);
+
+// Returns a version of 'r' with 'v' at the front, O(1)
+ralist *ralist_push(const ralist *r, atomtype v);
+
+// Returns a version of 'r' without its front element, O(1)
+ralist *ralist_pop(const ralist *r);
+
+// Copies element 'i' of 'r' into 'v', O(log n).
+// Returns false if 'i' is out of range
+bool ralist_get(const ralist *r, int i, atomtype *v);
+
+// Returns a version of 'r' with element 'i' replaced by 'v', O(log n).
+// If 'i' is out of range, returns another reference to 'r'
+ralist *ralist_set(const ralist *r, int i, atomtype v);
+
+// Returns a version holding 'a' followed by 'b', O(length of 'a')
+ralist *ralist_concat(const ralist *a, const ralist *b);
+
+// Returns number of elements, O(1)
+int ralist_length(const ralist *r);
+
+// Drops this reference to a version, the nodes go once unreferenced.
+// Double pointer allows function to set 'r' to NULL
+void ralist_free(ralist **r);
+
+// Returns a version holding the atoms of 'l' in the order
+// lisp_reduce() visits them, sub-lists being flattened
+ralist *ralist_fromlisp(const lisp *l);
+
+// Returns a new flat list of the elements of 'r'
+lisp *ralist_tolisp(const ralist *r);
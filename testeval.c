@@ -0,0 +1,165 @@
+#include "eval.h"
+#include "specific.h"
+
+#define LISTSTRLEN 1000
+// CDRs nested in one expression, more than LISP_PATHMAX
+#define DEEP 35
+
+// Operator codes spelled out, so programs can be written as strings
+#define QUOTE "1"
+#define NIL "2"
+#define VAR "3"
+#define CAR "4"
+#define CDR "5"
+#define CONS "6"
+#define PLUS "7"
+#define LENGTH "8"
+#define EQUAL "9"
+#define LESS "10"
+#define SET "11"
+#define IF "12"
+#define WHILE "13"
+
+void check(const char *program, const char *expected[LISP_NVARS]);
+void test_collector(void);
+
+int main(void)
+{
+   printf("Test Eval (%s) Start ... ", EVALIMPL);
+   assert(LISP_OP_WHILE == atoi(WHILE));
+
+   /* A = 0; B = 0; while (A < 10) { B = B + A; A = A + 1; } */
+   const char *sum[LISP_NVARS] = {"10", "45"};
+   check("((" SET " 0 (" QUOTE " 0)) (" SET " 1 (" QUOTE " 0)) "
+         "(" WHILE " (" LESS " (" VAR " 0) (" QUOTE " 10)) "
+         "((" SET " 1 (" PLUS " (" VAR " 1) (" VAR " 0))) "
+         "(" SET " 0 (" PLUS " (" VAR " 0) (" QUOTE " 1))))))",
+         sum);
+
+   // Blocks hold two instructions, as lisp_fromstring("((x))") gives (x)
+   const char *lists[LISP_NVARS] = {"(1 2 3)", "(0 2 3)", "3", "1", "2", "()", "((1 2 3) 1)", "1", "0"};
+   check("((" SET " 0 (" QUOTE " (1 2 3))) "
+         "(" SET " 1 (" CONS " (" QUOTE " 0) (" CDR " (" VAR " 0)))) "
+         "(" SET " 2 (" LENGTH " (" VAR " 1))) "
+         "(" SET " 3 (" EQUAL " (" VAR " 1) (" QUOTE " (0 2 3)))) "
+         "(" IF " (" LESS " (" VAR " 2) (" QUOTE " 2)) "
+         "((" SET " 4 (" QUOTE " 1)) (" SET " 8 (" QUOTE " 1))) "
+         "((" SET " 4 (" CAR " (" CDR " (" VAR " 0)))) (" SET " 8 (" QUOTE " 0)))) "
+         "(" SET " 5 (" NIL ")) "
+         "(" SET " 6 (" CONS " (" VAR " 0) (" CONS " (" CAR " (" VAR " 0)) (" NIL ")))) "
+         "(" SET " 7 (" EQUAL " (" VAR " 5) (" CDR " (" CDR " (" CDR " (" VAR " 0)))))))",
+         lists);
+
+   /* A = (1 2 3 4 5); B = 0; while (A) { B = B + car(A); A = cdr(A); }
+      Parts of a variable are read in place, and cut out when stored back */
+   const char *walk[LISP_NVARS] = {"()", "15", "1", "((3 4))"};
+   check("((" SET " 0 (" QUOTE " (1 2 3 4 5))) (" SET " 1 (" QUOTE " 0)) "
+         "(" WHILE " (" VAR " 0) "
+         "((" SET " 1 (" PLUS " (" VAR " 1) (" CAR " (" VAR " 0)))) "
+         "(" SET " 0 (" CDR " (" VAR " 0))))) "
+         "(" SET " 2 (" QUOTE " ((1 2) (3 4)))) (" SET " 3 (" CDR " (" VAR " 2))) "
+         "(" SET " 2 (" CAR " (" CAR " (" VAR " 2)))))",
+         walk);
+
+   // Deeper than LISP_PATHMAX, so the part read is copied out instead
+   char deep[LISTSTRLEN] = "((" SET " 0 (" QUOTE " (";
+   for (int i = 0; i < DEEP + 5; i++)
+   {
+      sprintf(deep + strlen(deep), "%d ", i);
+   }
+   strcat(deep, "))) (" SET " 1 ");
+   for (int i = 0; i < DEEP; i++)
+   {
+      strcat(deep, "(" CDR " ");
+   }
+   strcat(deep, "(" VAR " 0)");
+   for (int i = 0; i < DEEP; i++)
+   {
+      strcat(deep, ")");
+   }
+   strcat(deep, ") (" SET " 0 (" CAR " (" VAR " 1))))");
+   const char *deeper[LISP_NVARS] = {"35", "(35 36 37 38 39)"};
+   check(deep, deeper);
+
+   // Malformed: unknown operator, variable out of range, missing operand
+   const char *bad[3] = {"((" SET " 0 (" QUOTE " 0)) (99 0))",
+                         "((" SET " 0 (" QUOTE " 0)) (" SET " 26 (" QUOTE " 0)))",
+                         "((" SET " 0 (" QUOTE " 0)) (" SET " 0))"};
+   for (int i = 0; i < 3; i++)
+   {
+      lisp *l = lisp_fromstring(bad[i]);
+      lisp_env env;
+      lisp_env_init(&env);
+      assert(lisp_compile(l) == NULL);
+      assert(lisp_interp(l, &env) == false);
+      lisp_env_free(&env);
+      lisp_free(&l);
+   }
+   lisp_prog *empty = lisp_compile(NULL);
+   assert(empty);
+   lisp_prog_free(&empty);
+   assert(!empty);
+   test_collector();
+   lisp_cache_trim();
+   printf("End\n");
+   return 0;
+}
+
+// Runs 'program' through the tree walker and the VM (twice, to reuse
+// the bytecode) and compares every variable with 'expected'
+void check(const char *program, const char *expected[LISP_NVARS])
+{
+   char str[LISTSTRLEN];
+   lisp *l = lisp_fromstring(program);
+   assert(l);
+   lisp_prog *p = lisp_compile(l);
+   assert(p);
+   lisp_env walked, ran;
+   lisp_env_init(&walked);
+   lisp_env_init(&ran);
+   assert(lisp_interp(l, &walked));
+   lisp_free(&l);
+   lisp_run(p, &ran);
+   lisp_run(p, &ran);
+   for (int i = 0; i < LISP_NVARS; i++)
+   {
+      lisp_tostring(walked.vars[i], str);
+      assert(strcmp(str, expected[i] ? expected[i] : "()") == 0);
+      lisp_tostring(ran.vars[i], str);
+      assert(strcmp(str, expected[i] ? expected[i] : "()") == 0);
+   }
+   lisp_env_free(&walked);
+   lisp_env_free(&ran);
+   lisp_prog_free(&p);
+}
+
+// In collector mode a variable may share its list with other roots,
+// walking it must not cut the cells they still read
+void test_collector(void)
+{
+   char str[LISTSTRLEN];
+   lisp_heap_begin(NULL);
+   lisp *l = lisp_fromstring("((" SET " 1 (" CAR " (" VAR " 0))) (" SET " 0 (" CDR " (" VAR " 0))))");
+   lisp_prog *p = lisp_compile(l);
+   assert(p);
+   lisp *shared = lisp_fromstring("(1 2 3)");
+   lisp_heap_addroot(&shared);
+   lisp_env walked, ran;
+   lisp_env_init(&walked);
+   lisp_env_init(&ran);
+   walked.vars[0] = shared;
+   ran.vars[0] = shared;
+   assert(lisp_interp(l, &walked));
+   lisp_run(p, &ran);
+   lisp_tostring(walked.vars[0], str);
+   assert(strcmp(str, "(2 3)") == 0);
+   lisp_tostring(ran.vars[0], str);
+   assert(strcmp(str, "(2 3)") == 0);
+   assert(lisp_getval(walked.vars[1]) == 1 && lisp_getval(ran.vars[1]) == 1);
+   // The env is not rooted, only 'shared' must survive
+   lisp_heap_collect();
+   lisp_tostring(shared, str);
+   assert(strcmp(str, "(1 2 3)") == 0);
+   lisp_prog_free(&p);
+   lisp_heap_end();
+}
@@ -0,0 +1,150 @@
+#include <assert.h>
+#include "general.h"
+
+/* Cells hold row*100+col, so every test can tell which cell
+   landed where after a resize. */
+
+void fill(int** g, int h, int w);
+bool holds(int** g, int h, int w, int kh, int kw);
+void test_widen(void);
+void test_narrow_taller(void);
+void test_contig_nomem(void);
+void test_nbuf(void);
+
+int main(void)
+{
+   printf("Test General Start ... ");
+   test_widen();
+   test_narrow_taller();
+   test_contig_nomem();
+   test_nbuf();
+   printf("End\n");
+   return 0;
+}
+
+void fill(int** g, int h, int w)
+{
+   int i, j;
+   for(i=0; i<h; i++){
+      for(j=0; j<w; j++){
+         g[i][j] = i*100+j;
+      }
+   }
+}
+
+// The first kh x kw cells keep their values, all others are zero
+bool holds(int** g, int h, int w, int kh, int kw)
+{
+   int i, j;
+   for(i=0; i<h; i++){
+      for(j=0; j<w; j++){
+         int want = (i<kh && j<kw) ? i*100+j : 0;
+         if(g[i][j]!=want){
+            return false;
+         }
+      }
+      // Rows sit back to back in one slab
+      if(i>0 && g[i]!=g[i-1]+w){
+         return false;
+      }
+   }
+   return true;
+}
+
+void test_widen(void)
+{
+   int** g = (int**)n2dcalloc_contig(4, 3, sizeof(int));
+   fill(g, 4, 3);
+   g = (int**)n2drecalloc_contig((void**)g, 4, 4, 3, 7, sizeof(int));
+   assert(holds(g, 4, 7, 4, 3));
+   // Wider but shorter, the slab may end up smaller than before
+   fill(g, 4, 7);
+   g = (int**)n2drecalloc_contig((void**)g, 4, 2, 7, 9, sizeof(int));
+   assert(holds(g, 2, 9, 2, 7));
+   n2dfree_contig((void**)g);
+}
+
+void test_narrow_taller(void)
+{
+   int** g = (int**)n2dcalloc_contig(3, 6, sizeof(int));
+   fill(g, 3, 6);
+   // Narrower and taller, the slab grows although the rows get packed
+   g = (int**)n2drecalloc_contig((void**)g, 3, 8, 6, 2, sizeof(int));
+   assert(holds(g, 8, 2, 3, 2));
+   fill(g, 8, 2);
+   g = (int**)n2drecalloc_contig((void**)g, 8, 5, 2, 1, sizeof(int));
+   assert(holds(g, 5, 1, 5, 1));
+   n2dfree_contig((void**)g);
+}
+
+// A failed resize leaves the array as it was, whichever block failed
+void test_contig_nomem(void)
+{
+   // New heights and widths from a 4 x 5 array
+   const int sizes[][2] = {{9, 8}, {8, 2}, {2, 8}, {5, 4}, {3, 4}};
+   int** g = (int**)n2dcalloc_contig(4, 5, sizeof(int));
+   int i;
+   long budget;
+   fill(g, 4, 5);
+   set_errmode(ERR_RETURN);
+   for(i=0; i<5; i++){
+      const int* s = sizes[i];
+      for(budget=0; budget<2; budget++){
+         set_alloc_budget(budget);
+         void** n = n2drecalloc_contig((void**)g, 4, s[0], 5, s[1], sizeof(int));
+         set_alloc_budget(-1);
+         // Shrinking the slab needs only the row-pointer block
+         if(n){
+            assert(s[0]*s[1]<=20);
+            g = (int**)n2drecalloc_contig(n, s[0], 4, s[1], 5, sizeof(int));
+            fill(g, 4, 5);
+            continue;
+         }
+         assert(last_error()!=NULL);
+         clear_error();
+         assert(holds(g, 4, 5, 4, 5));
+      }
+   }
+   set_errmode(ERR_EXIT);
+   n2dfree_contig((void**)g);
+}
+
+void test_nbuf(void)
+{
+   nbuf b;
+   int* d;
+   int i, cap;
+   nbuf_init(&b, sizeof(int));
+   d = nbuf_resize(&b, 10);
+   cap = b.cap;
+   assert(cap>=10);
+   for(i=0; i<10; i++){
+      d[i] = i+1;
+   }
+   // Shrinking keeps the capacity, growing again must not bring back old cells
+   d = nbuf_resize(&b, 3);
+   assert(b.n==3 && b.cap==cap);
+   d = nbuf_resize(&b, 12);
+   assert(b.cap==cap);
+   for(i=0; i<12; i++){
+      assert(d[i]==(i<3 ? i+1 : 0));
+   }
+   // Past the capacity, the new tail is zero as well
+   d[11] = 7;
+   d = nbuf_resize(&b, 1);
+   d = nbuf_resize(&b, 40);
+   assert(b.cap>=40);
+   for(i=0; i<40; i++){
+      assert(d[i]==(i<1 ? 1 : 0));
+   }
+
+   set_errmode(ERR_RETURN);
+   set_alloc_budget(0);
+   assert(nbuf_resize(&b, 1000)==NULL);
+   set_alloc_budget(-1);
+   clear_error();
+   assert(b.n==40 && b.data==d && d[0]==1);
+   set_errmode(ERR_EXIT);
+   nbuf_free(&b);
+   assert(b.data==NULL && b.n==0 && b.cap==0);
+}
@@ -1,5 +1,6 @@
 #include "lisp.h"
 #include "specific.h"
+#include <limits.h>
 
 // It's more Lisp-like to call it cons() etc., not lisp_cons()
 #define atom(X) lisp_atom(X)
@@ -21,6 +22,8 @@
 // Prototype necessary for lisp_reduce() tests only */
 void times(lisp *l, atomtype *n);
 void atms(lisp *l, atomtype *n);
+// Generator necessary for lisp_lazy() tests only
+bool fib(void *state, atomtype *val);
 
 void test(void);
 
@@ -171,6 +174,362 @@ int main(void)
    assert(!h1);
    lisp_free(&h2);
    assert(!h2);
+
+   /*-------------------------------------------*/
+   /* lisp_free_async() & lisp_gc_step() tests  */
+   /*-------------------------------------------*/
+   assert(lisp_gc_step(10) == 0);
+   lisp *k1 = fromstring("(1 (2 (3 4)) 5)");
+   lisp *k2 = NIL;
+   for (int i = 0; i < 10000; i++)
+   {
+      // Nest down the car as well as the cdr
+      k2 = cons(cons(atom(i), NIL), k2);
+   }
+   lisp_free_async(&k1);
+   assert(!k1);
+   lisp_free_async(&k2);
+   assert(!k2);
+   lisp_free_async(&k2);
+   // 12 nodes in k1, 30000 in k2 and 1 cons joining the queue
+   int freed = 0;
+   for (int i = 0; i < 1000; i++)
+   {
+      int step = lisp_gc_step(7);
+      assert(step <= 7);
+      freed += step;
+   }
+   assert(freed > 0 && freed < 30013);
+   assert(freed + lisp_gc_drain() == 30013);
+   assert(lisp_gc_step(100) == 0);
+   lisp *k3 = atom(3);
+   lisp_free_async(&k3);
+   assert(lisp_gc_drain() == 1);
+   assert(lisp_gc_step(1) == 0);
+
+   /*---------------------------------*/
+   /* Collector mode (lisp_heap_*) tests */
+   /*---------------------------------*/
+   lisp_heapconf conf = {64, 100};
+   lisp_heapstats stats;
+   lisp_heap_begin(&conf);
+   lisp *m1 = fromstring("(1 2 3)");
+   lisp_heap_addroot(&m1);
+   // Shared: the same sub-list twice
+   lisp *m2 = lisp_list(2, m1, m1);
+   lisp_heap_addroot(&m2);
+   // Cyclic: the last cons points back to the front
+   lisp *m3 = cons(atom(4), cons(atom(5), NIL));
+   m3->cdr->cdr = m3;
+   lisp_heap_addroot(&m3);
+   lisp *m4 = copy(m1);
+   assert(lisp_length(m4) == 3);
+   assert(lisp_heap_collect() == 6);
+   lisp_heap_stats(&stats);
+   assert(stats.collections == 1);
+   assert(stats.live == 12);
+   assert(stats.heap == 64);
+   lisp_tostring(m2, str);
+   assert(strcmp(str, "((1 2 3) (1 2 3))") == 0);
+   lisp_free(&m3);
+   assert(!m3);
+   assert(lisp_heap_collect() == 4);
+   lisp_free(&m1);
+   // Still reachable through m2
+   assert(lisp_heap_collect() == 0);
+   lisp_free(&m2);
+   assert(lisp_heap_collect() == 8);
+   assert(lisp_heap_poll() == 0);
+   for (int i = 0; i < 200; i++)
+   {
+      m4 = cons(atom(i), NIL);
+   }
+   assert(lisp_getval(car(m4)) == 199);
+   assert(lisp_heap_poll() == 400);
+   lisp_heap_stats(&stats);
+   assert(stats.live == 0);
+   assert(stats.freed_total == 418);
+   assert(stats.max_pause_ms >= stats.last_pause_ms);
+   lisp_heap_end();
+
+   /*-----------------------------------*/
+   /* lisp_range() & lisp_lazy() tests  */
+   /*-----------------------------------*/
+   lisp *r1 = lisp_range(0, 10, 3);
+   assert(lisp_getval(car(r1)) == 0);
+   assert(lisp_length(r1) == 4);
+   lisp_tostring(r1, str);
+   assert(strcmp(str, "(0 3 6 9)") == 0);
+   lisp_free(&r1);
+   lisp *r2 = lisp_range(5, 0, -1);
+   lisp_tostring(r2, str);
+   assert(strcmp(str, "(5 4 3 2 1)") == 0);
+   lisp *r3 = copy(r2);
+   lisp_free(&r2);
+   lisp_tostring(r3, str);
+   assert(strcmp(str, "(5 4 3 2 1)") == 0);
+   lisp_free(&r3);
+   assert(lisp_range(1, 1, 1) == NIL);
+   assert(lisp_range(0, 10, 0) == NIL);
+   assert(lisp_range(0, 10, -1) == NIL);
+   // Only a prefix is ever materialised, the rest is dropped unvisited
+   lisp *r4 = lisp_range(0, 2000000000, 1);
+   assert(lisp_getval(car(cdr(cdr(r4)))) == 2);
+   lisp_free(&r4);
+   lisp *r5 = lisp_range(1, 5, 1);
+   acc = 1;
+   lisp_reduce(times, r5, &acc);
+   assert(acc == 24);
+   lisp_free_async(&r5);
+   lisp_gc_drain();
+   lisp *r6 = lisp_range(2147483640, 2147483647, 4);
+   lisp_tostring(r6, str);
+   assert(strcmp(str, "(2147483640 2147483644)") == 0);
+   lisp_free(&r6);
+   // Last steps at both ends of the int range
+   lisp *r10 = lisp_range(INT_MIN, INT_MIN + 1, 5);
+   assert(lisp_length(r10) == 1 && lisp_getval(car(r10)) == INT_MIN);
+   lisp_free(&r10);
+   r10 = lisp_range(INT_MIN + 10, INT_MIN, -4);
+   assert(lisp_length(r10) == 3 && lisp_getval(car(cdr(cdr(r10)))) == INT_MIN + 2);
+   lisp_free(&r10);
+   r10 = lisp_range(INT_MAX, INT_MAX - 1, -5);
+   assert(lisp_length(r10) == 1 && lisp_getval(car(r10)) == INT_MAX);
+   lisp_free(&r10);
+   r10 = lisp_range(INT_MAX - 1, INT_MAX, 5);
+   assert(lisp_length(r10) == 1 && lisp_getval(car(r10)) == INT_MAX - 1);
+   lisp_free(&r10);
+   r10 = lisp_range(INT_MIN, INT_MAX, INT_MAX);
+   lisp_tostring(r10, str);
+   assert(strcmp(str, "(-2147483648 -1 2147483646)") == 0);
+   lisp_free(&r10);
+   atomtype fibstate[3] = {0, 1, 50};
+   lisp *r7 = lisp_lazy(fib, fibstate);
+   lisp *r8 = cons(r7, cons(lisp_range(0, 2, 1), NIL));
+   lisp_tostring(r8, str);
+   assert(strcmp(str, "((0 1 1 2 3 5 8 13 21 34) (0 1))") == 0);
+   lisp_free(&r8);
+   lisp_heap_begin(NULL);
+   lisp *r9 = lisp_range(0, 100, 1);
+   lisp_heap_addroot(&r9);
+   assert(lisp_getval(car(cdr(r9))) == 1);
+   assert(lisp_heap_collect() == 0);
+   assert(lisp_length(r9) == 100);
+   lisp_free(&r9);
+   // 200 nodes, plus the 2 allocated when the range turned out exhausted
+   assert(lisp_heap_collect() == 202);
+   r9 = lisp_range(0, 100, 1);
+   // Taking a part of a shared list leaves the other roots intact
+   lisp *t1 = fromstring("((1 2) 3)");
+   lisp *alias = t1;
+   lisp_heap_addroot(&t1);
+   lisp_heap_addroot(&alias);
+   lisp *part = lisp_path_take(&t1, lisp_path_compile("cadr"));
+   assert(t1 == NIL && lisp_getval(part) == 3);
+   lisp_heap_collect();
+   lisp_tostring(alias, str);
+   assert(strcmp(str, "((1 2) 3)") == 0);
+   lisp_heap_end();
+
+   /*------------------------------------------------*/
+   /* lisp_c[ad]r, lisp_path_*() & lisp_extract tests */
+   /*------------------------------------------------*/
+   /*
+    (defvar p1 '((1 2) (3 (4 5)) 6))
+    (cadr (cadr p1)) output=(4 5)
+    (caddr p1) output=6
+   */
+   lisp *p1 = fromstring("((1 2) (3 (4 5)) 6)");
+   assert(lisp_getval(lisp_caar(p1)) == 1);
+   assert(lisp_getval(lisp_caddr(p1)) == 6);
+   assert(lisp_cdddr(p1) == NIL);
+   assert(lisp_getval(lisp_caadr(lisp_cadr(p1))) == 4);
+   lisp_tostring(lisp_cadr(lisp_cadr(p1)), str);
+   assert(strcmp(str, "(4 5)") == 0);
+   lisp_path pa1 = lisp_path_compile("caddr");
+   assert(pa1.len == 3);
+   assert(lisp_getval(lisp_path_get(p1, pa1)) == 6);
+   assert(lisp_path_compile("cr").len == -1);
+   assert(lisp_path_compile("cabr").len == -1);
+   assert(lisp_path_compile("addr").len == -1);
+   assert(lisp_path_compile(NULL).len == -1);
+   assert(lisp_path_get(p1, lisp_path_compile("cxr")) == NIL);
+   assert(lisp_path_get(NIL, pa1) == NIL);
+   char *specs[6] = {"caar", "cadar", "cadr", "caadr", "cdddddr", "cdadadr"};
+   lisp_path pa2[6];
+   lisp *got[6];
+   for (int i = 0; i < 6; i++)
+   {
+      pa2[i] = lisp_path_compile(specs[i]);
+   }
+   lisp_extract(p1, pa2, 6, got);
+   assert(lisp_getval(got[0]) == 1);
+   assert(lisp_getval(got[1]) == 2);
+   assert(got[2] == lisp_cadr(p1));
+   assert(lisp_getval(got[3]) == 3);
+   assert(got[4] == NIL);
+   assert(got[5] == lisp_cdr(lisp_cadr(lisp_cadr(p1))));
+   for (int i = 0; i < 6; i++)
+   {
+      assert(got[i] == lisp_path_get(p1, pa2[i]));
+   }
+   lisp *kept = lisp_cadr(lisp_cadr(p1));
+   assert(lisp_path_take(&p1, lisp_path_compile("cadadr")) == kept);
+   assert(p1 == NIL);
+   lisp_tostring(kept, str);
+   assert(strcmp(str, "(4 5)") == 0);
+   assert(lisp_path_take(&kept, lisp_path_compile("cddr")) == NIL);
+   assert(kept == NIL);
+   // Walking a lazy list only keeps the part not yet visited
+   lisp *p2 = lisp_range(0, 5, 1);
+   p2 = lisp_path_take(&p2, lisp_path_compile("cddr"));
+   lisp_tostring(p2, str);
+   assert(strcmp(str, "(2 3 4)") == 0);
+   lisp_free(&p2);
+
+   /*--------------------------------------------*/
+   /* lisp_write_fd() & lisp_write_file() tests  */
+   /*--------------------------------------------*/
+   FILE *fp = tmpfile();
+   assert(fp);
+   lisp *w[5] = {fromstring("(0 (1 -2) 3 4 50)"), NIL, atom(-2147483647 - 1),
+                 cons(NIL, cons(atom(1), NIL)), fromstring("((-1 2) (3 4) (5 (6 7)))")};
+   fprintf(fp, "head\n");
+   assert(lisp_write_file(fp, (const lisp **)w, 5) == 65);
+   assert(lisp_write_fd(-1, (const lisp **)w, 5) == -1);
+   rewind(fp);
+   char line[LISTSTRLEN];
+   assert(fgets(line, LISTSTRLEN, fp) && strcmp(line, "head\n") == 0);
+   for (int i = 0; i < 5; i++)
+   {
+      lisp_tostring(w[i], str);
+      strcat(str, "\n");
+      assert(fgets(line, LISTSTRLEN, fp) && strcmp(line, str) == 0);
+      lisp_free(&w[i]);
+   }
+   assert(fgets(line, LISTSTRLEN, fp) == NULL);
+   fclose(fp);
+   // Longer than one batch of buffers, so flushed part way through
+   fp = tmpfile();
+   lisp *w1 = lisp_range(0, 400000, 1);
+   long bytes = lisp_write_file(fp, (const lisp **)&w1, 1);
+   assert(bytes == ftell(fp));
+   assert(bytes > 2000000);
+   rewind(fp);
+   assert(fgets(line, 12, fp) && strcmp(line, "(0 1 2 3 4 ") == 0);
+   fseek(fp, -8, SEEK_END);
+   assert(fgets(line, LISTSTRLEN, fp) && strcmp(line, "399999)\n") == 0);
+   fclose(fp);
+   lisp_write_release();
+   // Chunks are allocated one by one, with only the first the output is flushed more often
+   set_errmode(ERR_RETURN);
+   fp = tmpfile();
+   set_alloc_budget(0);
+   assert(lisp_write_file(fp, (const lisp **)&w1, 1) == -1);
+   set_alloc_budget(1);
+   assert(lisp_write_file(fp, (const lisp **)&w1, 1) == bytes);
+   set_alloc_budget(-1);
+   clear_error();
+   set_errmode(ERR_EXIT);
+   assert(ftell(fp) == bytes);
+   fclose(fp);
+   lisp_write_release();
+   // Too long for the recursive lisp_free()
+   lisp_free_async(&w1);
+   lisp_gc_drain();
+
+   /*---------------------------------------*/
+   /* Error mode & node cache tests         */
+   /*---------------------------------------*/
+   set_errmode(ERR_RETURN);
+   assert(last_error() == NULL);
+   on_error("Recorded, not fatal");
+   assert(strcmp(last_error(), "Recorded, not fatal") == 0);
+   clear_error();
+   assert(last_error() == NULL);
+   // Each allocation in turn fails until the call succeeds, partly
+   // built lists must be freed (leaks show up in the sanitizer build)
+   lisp *e0 = lisp_list(2, fromstring("(1 (2 3) 4)"), lisp_range(5, 8, 1));
+   lisp *e1 = atom(1);
+   lisp *e2 = fromstring("(2 3)");
+   const char *built[3] = {"(1 (2 3) 4)", "((1 (2 3) 4) (5 6 7))", "(1 (2 3))"};
+   for (int op = 0; op < 3; op++)
+   {
+      int fails = 0;
+      lisp *e = NIL;
+      while (!e)
+      {
+         lisp_cache_trim();
+         set_alloc_budget(fails);
+         e = op == 0 ? fromstring("(1 (2 3) 4)") : (op == 1 ? copy(e0) : lisp_list(2, e1, e2));
+         set_alloc_budget(-1);
+         if (!e)
+         {
+            assert(last_error());
+            clear_error();
+            fails++;
+         }
+      }
+      assert(fails > 0);
+      lisp_tostring(e, str);
+      assert(strcmp(str, built[op]) == 0);
+      // Frees e1 and e2 too, which lisp_list() reused
+      lisp_free(&e);
+   }
+   lisp_free(&e0);
+   // A lazy cell that cannot be forced stays lazy
+   lisp *e3 = lisp_range(0, 3, 1);
+   lisp_cache_trim();
+   set_alloc_budget(0);
+   assert(cdr(e3) == NIL);
+   set_alloc_budget(-1);
+   assert(lisp_length(e3) == 3);
+   lisp_free(&e3);
+   // lisp_free_async() with no node to queue with frees at once
+   lisp *e4 = fromstring("(1 2)");
+   lisp *e5 = fromstring("(3 4 5)");
+   lisp_free_async(&e4);
+   lisp_cache_trim();
+   set_alloc_budget(0);
+   lisp_free_async(&e5);
+   set_alloc_budget(-1);
+   assert(!e5);
+   assert(lisp_gc_drain() == 4);
+   // Collector: failing to grow the roots or the mark stack
+   lisp_heap_begin(NULL);
+   lisp *e6 = fromstring("(1 2)");
+   set_alloc_budget(0);
+   assert(!lisp_heap_addroot(&e6));
+   set_alloc_budget(-1);
+   assert(lisp_heap_addroot(&e6));
+   lisp *e7 = fromstring("(3 4)");
+   lisp_free(&e7);
+   set_alloc_budget(0);
+   assert(lisp_heap_collect() == 0);
+   set_alloc_budget(-1);
+   assert(lisp_heap_collect() == 4);
+   assert(lisp_getval(car(cdr(e6))) == 2);
+   lisp_heap_end();
+   clear_error();
+   set_errmode(ERR_EXIT);
+   lisp *c1 = lisp_range(0, 1000, 1);
+   assert(lisp_length(c1) == 1000);
+   lisp_free(&c1);
+   // Freed nodes are handed out again by this thread
+   lisp *c2 = atom(1);
+   lisp *c3 = atom(2);
+   lisp *reused = c3;
+   lisp_free(&c3);
+   lisp *c4 = atom(3);
+   assert(c4 == reused);
+   lisp_cache_flush();
+   lisp *c5 = lisp_range(0, 1000, 1);
+   assert(lisp_getval(lisp_cadddr(c5)) == 3);
+   assert(lisp_length(c5) == 1000);
+   lisp_free(&c5);
+   lisp_free(&c2);
+   lisp_free(&c4);
+   lisp_cache_trim();
    printf("End\n");
    return 0;
 }
@@ -188,3 +547,18 @@ void atms(lisp *l, atomtype *accum)
    // but prevents unused warning for variable 'l'...
    *accum = *accum + lisp_isatomic(l);
 }
+
+// Fibonacci numbers below state[2], state[0..1] hold the next two
+bool fib(void *state, atomtype *val)
+{
+   atomtype *s = (atomtype *)state;
+   if (s[0] >= s[2])
+   {
+      return false;
+   }
+   *val = s[0];
+   atomtype next = s[0] + s[1];
+   s[0] = s[1];
+   s[1] = next;
+   return true;
+}
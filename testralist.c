@@ -0,0 +1,290 @@
+#include "ralist.h"
+#include "specific.h"
+#include <pthread.h>
+
+#define LISTSTRLEN 1000
+#define BIGLIST 10000
+#define NREADERS 4
+#define SNAPLEN 1000
+#define WRITES 20000
+#define READS 200
+
+/* Readers take snapshots published by a writer, which keeps deriving
+   versions with ralist_set/push/pop and freeing the old ones.
+   Only the hand-over slot is locked, never the lists themselves */
+typedef struct shared
+{
+   pthread_mutex_t lock;
+   ralist *published;
+} shared;
+
+typedef struct readerarg
+{
+   shared *sh;
+   // The first published version, shared before the reader starts
+   ralist *first;
+} readerarg;
+
+void *writer(void *arg);
+void *reader(void *arg);
+void test_threads(void);
+void test_nomem(void);
+
+int main(void)
+{
+   char str[LISTSTRLEN];
+   atomtype v;
+   printf("Test RAList (%s) Start ... ", RALISTIMPL);
+
+   assert(ralist_length(NULL) == 0);
+   assert(ralist_get(NULL, 0, &v) == false);
+   assert(ralist_pop(NULL) == NULL);
+
+   /*---------------------------*/
+   /* push, get & pop tests     */
+   /*---------------------------*/
+   ralist *r1 = NULL;
+   for (int i = BIGLIST - 1; i >= 0; i--)
+   {
+      ralist *next = ralist_push(r1, i);
+      ralist_free(&r1);
+      r1 = next;
+   }
+   assert(ralist_length(r1) == BIGLIST);
+   for (int i = 0; i < BIGLIST; i++)
+   {
+      assert(ralist_get(r1, i, &v));
+      assert(v == i);
+   }
+   assert(ralist_get(r1, BIGLIST, &v) == false);
+   assert(ralist_get(r1, -1, &v) == false);
+   ralist *r2 = ralist_pop(r1);
+   assert(ralist_length(r2) == BIGLIST - 1);
+   assert(ralist_get(r2, 0, &v) && v == 1);
+   assert(ralist_get(r2, BIGLIST - 2, &v) && v == BIGLIST - 1);
+
+   /*---------------------------------------*/
+   /* set tests - old versions are retained */
+   /*---------------------------------------*/
+   ralist *r3 = ralist_set(r1, 4321, -1);
+   assert(ralist_get(r3, 4321, &v) && v == -1);
+   assert(ralist_get(r1, 4321, &v) && v == 4321);
+   assert(ralist_get(r3, 4320, &v) && v == 4320);
+   assert(ralist_get(r3, 4322, &v) && v == 4322);
+   ralist *r4 = ralist_set(r3, BIGLIST, 7);
+   assert(r4 == r3);
+   ralist_free(&r4);
+   // Dropping the original leaves the derived versions intact
+   ralist_free(&r1);
+   assert(!r1);
+   assert(ralist_get(r2, 4320, &v) && v == 4321);
+   assert(ralist_get(r3, 4321, &v) && v == -1);
+   ralist_free(&r2);
+   ralist_free(&r3);
+
+   /*----------------------------------*/
+   /* lisp conversion & concat tests   */
+   /*----------------------------------*/
+   lisp *l1 = lisp_fromstring("(1 (2 3) 4 (5 (6)))");
+   ralist *r5 = ralist_fromlisp(l1);
+   assert(ralist_length(r5) == 6);
+   lisp *l2 = ralist_tolisp(r5);
+   lisp_tostring(l2, str);
+   assert(strcmp(str, "(1 2 3 4 5 6)") == 0);
+   lisp *l3 = lisp_range(7, 10, 1);
+   ralist *r6 = ralist_fromlisp(l3);
+   ralist *r7 = ralist_concat(r5, r6);
+   assert(ralist_length(r7) == 9);
+   ralist *r8 = ralist_set(r7, 8, 0);
+   lisp *l4 = ralist_tolisp(r8);
+   lisp_tostring(l4, str);
+   assert(strcmp(str, "(1 2 3 4 5 6 7 8 0)") == 0);
+   ralist *r9 = ralist_concat(NULL, r6);
+   assert(ralist_length(r9) == 3);
+   ralist *r10 = ralist_share(r9);
+   ralist_free(&r9);
+   assert(ralist_get(r10, 2, &v) && v == 9);
+   assert(ralist_tolisp(NULL) == NULL);
+   assert(ralist_fromlisp(NULL) == NULL);
+   ralist *r11 = ralist_fromlisp(lisp_car(l1));
+   assert(ralist_length(r11) == 1);
+
+   ralist *rs[7] = {r5, r6, r7, r8, r9, r10, r11};
+   for (int i = 0; i < 7; i++)
+   {
+      ralist_free(&rs[i]);
+   }
+   lisp *ls[4] = {l1, l2, l3, l4};
+   for (int i = 0; i < 4; i++)
+   {
+      lisp_free(&ls[i]);
+   }
+   test_threads();
+   test_nomem();
+   lisp_cache_trim();
+   printf("End\n");
+   return 0;
+}
+
+void test_threads(void)
+{
+   shared sh;
+   pthread_mutex_init(&sh.lock, NULL);
+   sh.published = NULL;
+   for (int i = SNAPLEN - 1; i >= 0; i--)
+   {
+      ralist *next = ralist_push(sh.published, i);
+      ralist_free(&sh.published);
+      sh.published = next;
+   }
+   readerarg args[NREADERS + 1];
+   pthread_t th[NREADERS + 1];
+   for (int i = 1; i <= NREADERS; i++)
+   {
+      args[i] = (readerarg){&sh, ralist_share(sh.published)};
+   }
+   int r = pthread_create(&th[0], NULL, writer, &sh);
+   assert(r == 0);
+   for (int i = 1; i <= NREADERS; i++)
+   {
+      r = pthread_create(&th[i], NULL, reader, &args[i]);
+      assert(r == 0);
+   }
+   for (int i = 0; i <= NREADERS; i++)
+   {
+      r = pthread_join(th[i], NULL);
+      assert(r == 0);
+   }
+   ralist_free(&sh.published);
+   pthread_mutex_destroy(&sh.lock);
+}
+
+void *writer(void *arg)
+{
+   shared *sh = (shared *)arg;
+   pthread_mutex_lock(&sh->lock);
+   ralist *cur = ralist_share(sh->published);
+   pthread_mutex_unlock(&sh->lock);
+   for (int i = 0; i < WRITES; i++)
+   {
+      ralist *next;
+      switch (i % 3)
+      {
+      case 0:
+         next = ralist_set(cur, (i * 7) % ralist_length(cur), -i);
+         break;
+      case 1:
+         next = ralist_push(cur, i);
+         break;
+      default:
+         next = ralist_pop(cur);
+      }
+      ralist_free(&cur);
+      cur = next;
+      if (i % 100 == 0)
+      {
+         ralist *old;
+         pthread_mutex_lock(&sh->lock);
+         old = sh->published;
+         sh->published = ralist_share(cur);
+         pthread_mutex_unlock(&sh->lock);
+         ralist_free(&old);
+      }
+   }
+   ralist_free(&cur);
+   lisp_cache_flush();
+   return NULL;
+}
+
+// Every snapshot must read the same on each pass while the writer runs,
+// and the first version must still hold 0 .. SNAPLEN - 1
+void *reader(void *arg)
+{
+   shared *sh = ((readerarg *)arg)->sh;
+   ralist *first = ((readerarg *)arg)->first;
+   static __thread atomtype seen[SNAPLEN + WRITES];
+   atomtype v;
+   for (int k = 0; k < READS; k++)
+   {
+      pthread_mutex_lock(&sh->lock);
+      ralist *snap = ralist_share(sh->published);
+      pthread_mutex_unlock(&sh->lock);
+      int n = ralist_length(snap);
+      for (int i = 0; i < n; i++)
+      {
+         assert(ralist_get(snap, i, &seen[i]));
+      }
+      for (int pass = 0; pass < 3; pass++)
+      {
+         assert(ralist_length(snap) == n);
+         for (int i = 0; i < n; i++)
+         {
+            assert(ralist_get(snap, i, &v) && v == seen[i]);
+         }
+      }
+      ralist_free(&snap);
+      int i = (k * 37) % SNAPLEN;
+      assert(ralist_get(first, i, &v) && v == i);
+   }
+   ralist_free(&first);
+   lisp_cache_flush();
+   return NULL;
+}
+
+// In ERR_RETURN mode each allocation in turn fails until the call
+// succeeds: nothing may leak and the argument must stay intact
+void test_nomem(void)
+{
+   atomtype v;
+   lisp *l = lisp_range(0, 100, 1);
+   ralist *base = ralist_fromlisp(l);
+   set_errmode(ERR_RETURN);
+   for (int op = 0; op < 5; op++)
+   {
+      int fails = 0;
+      ralist *r = NULL;
+      lisp *back = NULL;
+      while (!r && !back)
+      {
+         lisp_cache_trim();
+         set_alloc_budget(fails);
+         switch (op)
+         {
+         case 0:
+            r = ralist_set(base, 77, -1);
+            break;
+         case 1:
+            r = ralist_pop(base);
+            break;
+         case 2:
+            r = ralist_concat(base, base);
+            break;
+         case 3:
+            r = ralist_fromlisp(l);
+            break;
+         default:
+            back = ralist_tolisp(base);
+         }
+         set_alloc_budget(-1);
+         if (!r && !back)
+         {
+            assert(last_error());
+            clear_error();
+            fails++;
+         }
+      }
+      assert(fails > 0);
+      int lengths[5] = {100, 99, 200, 100, 100};
+      assert(ralist_length(r) == lengths[op] || lisp_length(back) == lengths[op]);
+      assert(op != 0 || (ralist_get(r, 77, &v) && v == -1));
+      ralist_free(&r);
+      lisp_free(&back);
+   }
+   for (int i = 0; i < 100; i++)
+   {
+      assert(ralist_get(base, i, &v) && v == i);
+   }
+   set_errmode(ERR_EXIT);
+   ralist_free(&base);
+   lisp_free(&l);
+}
@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include "lisp.h"
+
+#define MAXTHREADS 64
+#define ROUNDS 2000
+#define LISTLEN 100
+#define SLOTS 8
+
+/* Stress: every worker builds lists and hands them to its neighbour,
+   which frees them, so nodes constantly cross threads.
+   Throughput: every worker builds and frees its own lists,
+   reported for 1 up to all cores. */
+
+typedef struct worker
+{
+   int id;
+   int nthreads;
+   long rounds;
+   long checksum;
+} worker;
+
+// Hand-over slots, worker i fills row i and empties row i - 1
+static lisp *slots[MAXTHREADS][SLOTS];
+
+void *stress(void *arg);
+void *throughput(void *arg);
+lisp *build(int seed);
+double now(void);
+void sum(lisp *l, atomtype *acc);
+
+int main(void)
+{
+   long ncores = sysconf(_SC_NPROCESSORS_ONLN);
+   int maxthreads = ncores < 2 ? 2 : (ncores > MAXTHREADS ? MAXTHREADS : (int)ncores);
+   pthread_t th[MAXTHREADS];
+   worker w[MAXTHREADS];
+   // Thread calls stay outside assert(), which -DNDEBUG compiles out
+   int r = 0;
+   (void)r;
+   printf("Test Stress (%d threads) Start ... ", maxthreads);
+
+   // Collector mode is per thread, the workers keep freeing their nodes
+   lisp_heap_begin(NULL);
+   lisp *mine = build(0);
+   lisp_heap_addroot(&mine);
+   for (int i = 0; i < maxthreads; i++)
+   {
+      w[i] = (worker){i, maxthreads, ROUNDS, 0};
+      r = pthread_create(&th[i], NULL, stress, &w[i]);
+      assert(r == 0);
+   }
+   long checksum = 0;
+   for (int i = 0; i < maxthreads; i++)
+   {
+      r = pthread_join(th[i], NULL);
+      assert(r == 0);
+      checksum += w[i].checksum;
+   }
+   lisp_heapstats hs;
+   lisp_heap_stats(&hs);
+   assert(hs.live == 2 * LISTLEN && lisp_length(mine) == LISTLEN);
+   lisp_heap_end();
+   // Each list holds seed * LISTLEN + 0, + 1, ... + LISTLEN - 1
+   long expected = 0;
+   for (int i = 0; i < maxthreads; i++)
+   {
+      for (int k = 0; k < ROUNDS; k++)
+      {
+         expected += (long)(i * ROUNDS + k) * LISTLEN * LISTLEN + LISTLEN * (LISTLEN - 1) / 2;
+      }
+   }
+   assert(checksum == expected);
+
+   // A failing worker gets NULL back instead of the process exiting.
+   // With the caches emptied the atom must come from the allocator
+   lisp_cache_trim();
+   set_errmode(ERR_RETURN);
+   set_alloc_budget(0);
+   lisp *none = lisp_atom(1);
+   set_alloc_budget(-1);
+   assert(none == NULL);
+   (void)none;
+   assert(last_error() != NULL);
+   clear_error();
+   set_errmode(ERR_EXIT);
+   printf("End\n");
+
+   double base = 0;
+   for (int n = 1; n <= (int)ncores && n <= MAXTHREADS; n++)
+   {
+      double bgn = now();
+      for (int i = 0; i < n; i++)
+      {
+         w[i] = (worker){i, n, ROUNDS * 10, 0};
+         r = pthread_create(&th[i], NULL, throughput, &w[i]);
+         assert(r == 0);
+      }
+      for (int i = 0; i < n; i++)
+      {
+         r = pthread_join(th[i], NULL);
+         assert(r == 0);
+      }
+      // Each round allocates and frees 2 * LISTLEN nodes
+      double mops = (double)n * ROUNDS * 10 * 2 * LISTLEN / (now() - bgn) / 1e6;
+      base = n == 1 ? mops : base;
+      printf("%2d threads: %8.2f Mnodes/s (x%.2f)\n", n, mops, mops / base);
+   }
+   lisp_cache_trim();
+   return 0;
+}
+
+lisp *build(int seed)
+{
+   lisp *l = NULL;
+   for (int i = LISTLEN - 1; i >= 0; i--)
+   {
+      l = lisp_cons(lisp_atom(seed * LISTLEN + i), l);
+   }
+   return l;
+}
+
+void sum(lisp *l, atomtype *acc)
+{
+   *acc += lisp_getval(l);
+}
+
+void *stress(void *arg)
+{
+   worker *w = (worker *)arg;
+   int from = (w->id + w->nthreads - 1) % w->nthreads;
+   long made = 0;
+   long taken = 0;
+   for (long spin = 0; made < w->rounds || taken < w->rounds; spin++)
+   {
+      int k = (int)(spin % SLOTS);
+      bool progress = false;
+      if (made < w->rounds && !__atomic_load_n(&slots[w->id][k], __ATOMIC_ACQUIRE))
+      {
+         lisp *l = build(w->id * (int)w->rounds + (int)made);
+         __atomic_store_n(&slots[w->id][k], l, __ATOMIC_RELEASE);
+         made++;
+         progress = true;
+      }
+      lisp *l = __atomic_exchange_n(&slots[from][k], NULL, __ATOMIC_ACQUIRE);
+      if (l)
+      {
+         // Freed here, on a different thread than the one that built it
+         atomtype acc = 0;
+         lisp_reduce(sum, l, &acc);
+         w->checksum += acc;
+         lisp_free(&l);
+         taken++;
+         progress = true;
+      }
+      if (!progress)
+      {
+         sched_yield();
+      }
+   }
+   lisp_cache_flush();
+   return NULL;
+}
+
+void *throughput(void *arg)
+{
+   worker *w = (worker *)arg;
+   for (long r = 0; r < w->rounds; r++)
+   {
+      lisp *l = build(w->id);
+      w->checksum += lisp_length(l);
+      lisp_free(&l);
+   }
+   lisp_cache_flush();
+   return NULL;
+}
+
+double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}